@@ -0,0 +1,127 @@
+/*
+ *  Copyright 2018-2021 ledmaker.org
+ *
+ *  This file is part of Glow Decompiler Lib.
+ *
+ */
+
+#include "public_api.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#ifdef GLOW_ANIMATION_INSTANCES
+
+#include "bit_handler.h"
+#include "decode_metadata.h"
+#include "ledstrip_buffer.h"
+#ifdef GLOW_APPLY_WORKERS
+#include "parallel_apply.h"
+#endif
+
+#if defined(GLOW_PLAYLIST_STAGING_BUF_SZ) || defined(GLOW_RENDER_AHEAD_FRAMES) || defined(GLOW_CONTEXT_PAGES) || defined(GLOW_PLANAR_LEDS)
+#error "GLOW_ANIMATION_INSTANCES is not combined with playlists, render-ahead, context pages or planar leds"
+#endif
+
+#define NO_INSTANCE 0xFFFF
+
+/**
+ * Decoder state of an animation instance, swapped out while other instances run.
+**/
+struct AnimationInstance
+{
+#ifdef GLOW_APPLY_WORKERS
+    _Alignas(CACHE_LINE_SZ) struct Led leds[LED_COUNT];    // parallel apply ranges start on cache line boundaries.
+#else
+    struct Led leds[LED_COUNT];
+#endif
+    uint8_t *ptrSramBuffer;
+    bool isSaveToRom;
+    bool isLedstripDirty;
+    struct GlobalContext globalContext;
+    struct PathContext pathContext;
+    struct PathIndex pathIndex;
+};
+
+static struct AnimationInstance instances[GLOW_ANIMATION_INSTANCES];
+static uint16_t activeInstanceIdx = NO_INSTANCE;
+
+static void SaveActiveInstance()
+{
+    if (activeInstanceIdx == NO_INSTANCE) return;
+
+    struct AnimationInstance *ptrInstance = &instances[activeInstanceIdx];
+    ptrInstance->globalContext = gContext;
+    ptrInstance->pathContext = pContext;
+    ptrInstance->isLedstripDirty = ledstripBuffer.isDirty;
+    SavePathIndex(&ptrInstance->pathIndex);
+}
+
+static void SelectInstanceBuffers(uint16_t instanceIdx)
+{
+    // Point sram buffer and ledstrip color data at the instance's own storage:
+    activeInstanceIdx = instanceIdx;
+    ptrSramBufferStart = instances[instanceIdx].ptrSramBuffer;
+    ledstripBuffer.leds = instances[instanceIdx].leds;
+}
+
+static void SwitchToInstance(uint16_t instanceIdx)
+{
+    if (instanceIdx == activeInstanceIdx) return;
+
+    SaveActiveInstance();
+    SelectInstanceBuffers(instanceIdx);
+
+    // Restore decoder state, the bit handlers are re-pointed at the instance's sram buffer:
+    struct AnimationInstance *ptrInstance = &instances[instanceIdx];
+    gContext = ptrInstance->globalContext;
+    pContext = ptrInstance->pathContext;
+    ledstripBuffer.isDirty = ptrInstance->isLedstripDirty;
+    RestorePathIndex(&ptrInstance->pathIndex);
+    InitContextBitHandler(ptrSramBufferStart);
+    InitInstrBitHandler(ptrSramBufferStart + gContext.contextSramByteLen);
+}
+
+bool InitAnimationInstance(uint16_t instanceIdx, uint8_t *ptrSramBuffer, uint32_t nvmStartAddr, bool isSaveToRom)
+{
+    Assert(instanceIdx < GLOW_ANIMATION_INSTANCES);
+
+    SaveActiveInstance();
+    instances[instanceIdx].ptrSramBuffer = ptrSramBuffer;
+    instances[instanceIdx].isSaveToRom = isSaveToRom;
+    SelectInstanceBuffers(instanceIdx);
+
+    gContext.nvmStartAddr = nvmStartAddr;
+    ledstripBuffer.isDirty = false;
+    if (!LoadAnimationContext(isSaveToRom, false))
+    {
+        return false;
+    }
+
+    SetLedstripTestColor(0, 0, 0, 0);   // turn off all leds.
+
+    return true;
+}
+
+bool RunAnimationInstance(uint16_t instanceIdx)
+{
+    Assert(instanceIdx < GLOW_ANIMATION_INSTANCES);
+
+    SwitchToInstance(instanceIdx);
+
+    return RunAnimation(instances[instanceIdx].isSaveToRom);
+}
+
+uint16_t GetActiveAnimationInstance()
+{
+    return activeInstanceIdx;
+}
+
+uint16_t GetAnimationInstanceTickInterval(uint16_t instanceIdx)
+{
+    if (instanceIdx == activeInstanceIdx) return gContext.tickIntervalMs_Value;
+
+    return instances[instanceIdx].globalContext.tickIntervalMs_Value;
+}
+
+#endif
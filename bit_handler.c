@@ -9,14 +9,22 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include "bit_handler.h"
+#include "context_pager.h"
 
 #define BITS_PER_BYTE 8
+#define MAX_BITFIELD_BYTE_LEN 5     // bytes spanned by a 32-bit bitfield at any bit offset.
 
-static uint8_t *bufInstrStartPtr;
+static GLOW_THREAD_LOCAL uint8_t *bufInstrStartPtr;
 static uint8_t *bufContextStartPtr;
-static volatile uint32_t bitInstrIndex;
+static GLOW_THREAD_LOCAL volatile uint32_t bitInstrIndex;
 static volatile uint32_t bitContextIndex;
 
+#ifdef GLOW_PATH_WORKERS
+#include <pthread.h>
+static pthread_mutex_t contextWriteMutex = PTHREAD_MUTEX_INITIALIZER;   // path decoding threads share metadata-region bytes.
+#endif
+
 void InitInstrBitHandler(uint8_t *startPtr)
 {
 	bufInstrStartPtr = startPtr;
@@ -61,7 +69,7 @@ void FastForwardContextBits(uint32_t numBits)
 
 static void SetBitfieldValue(uint8_t *startPtr, uint32_t bitAddress, uint8_t bitfieldWidth, uint32_t u32Val)
 {
-    Assert(bitfieldWidth <= 32);
+    DecodeAssert(bitfieldWidth <= 32);
 
 	uint32_t endBitIndex = bitAddress + bitfieldWidth - 1;
 	uint32_t startByteIndex = bitAddress / 8;
@@ -88,14 +96,44 @@ static void SetBitfieldValue(uint8_t *startPtr, uint32_t bitAddress, uint8_t bit
 //    SetBitfieldValue(bufInstrStartPtr, bitAddress, bitfieldWidth, u32Val);
 //}
 
+#ifdef GLOW_CONTEXT_PAGES
+static void SetPagedBitfieldValue(uint32_t bitAddress, uint8_t bitfieldWidth, uint32_t u32Val)
+{
+    uint8_t bitfieldBytes[MAX_BITFIELD_BYTE_LEN];
+    uint8_t bitOffset = bitAddress % BITS_PER_BYTE;
+    uint8_t byteLen = (bitOffset + bitfieldWidth + BITS_PER_BYTE - 1) / BITS_PER_BYTE;
+
+    if (bitfieldWidth == 0) return;   // handle case where opcode indicates absent value field.
+
+    // Modify a copy of the bytes containing bitfield and write them back to their pages:
+    ReadContextPageBytes(bitAddress / BITS_PER_BYTE, bitfieldBytes, byteLen);
+    SetBitfieldValue(bitfieldBytes, bitOffset, bitfieldWidth, u32Val);
+    WriteContextPageBytes(bitAddress / BITS_PER_BYTE, bitfieldBytes, byteLen);
+}
+#endif
+
 void SetContextBitfieldValue(uint32_t bitAddress, uint8_t bitfieldWidth, uint32_t u32Val)
 {
+#ifdef GLOW_CONTEXT_PAGES
+    if (IsContextPaged())
+    {
+        SetPagedBitfieldValue(bitAddress, bitfieldWidth, u32Val);
+        return;
+    }
+#endif
+
+#ifdef GLOW_PATH_WORKERS
+    pthread_mutex_lock(&contextWriteMutex);
     SetBitfieldValue(bufContextStartPtr, bitAddress, bitfieldWidth, u32Val);
+    pthread_mutex_unlock(&contextWriteMutex);
+#else
+    SetBitfieldValue(bufContextStartPtr, bitAddress, bitfieldWidth, u32Val);
+#endif
 }
 
 static uint32_t GetBitfieldValue(uint8_t *startPtr, uint32_t bitAddress, uint8_t bitfieldWidth)
 {
-    Assert(bitfieldWidth <= 32);
+    DecodeAssert(bitfieldWidth <= 32);
 
 	uint32_t endBitIndex = bitAddress + bitfieldWidth - 1;
 	uint32_t leftByteIndex = bitAddress / 8;	// must be signed.
@@ -122,6 +160,32 @@ static uint32_t GetBitfieldValue(uint8_t *startPtr, uint32_t bitAddress, uint8_t
 	return (uint32_t)u64Val;
 }
 
+#ifdef GLOW_CONTEXT_PAGES
+static uint32_t GetPagedBitfieldValue(uint32_t bitAddress, uint8_t bitfieldWidth)
+{
+    uint8_t bitfieldBytes[MAX_BITFIELD_BYTE_LEN];
+    uint8_t bitOffset = bitAddress % BITS_PER_BYTE;
+    uint8_t byteLen = (bitOffset + bitfieldWidth + BITS_PER_BYTE - 1) / BITS_PER_BYTE;
+
+    if (bitfieldWidth == 0) return 0;   // handle case where opcode indicates absent value field.
+
+    // Decode bitfield from a copy of the bytes containing it:
+    ReadContextPageBytes(bitAddress / BITS_PER_BYTE, bitfieldBytes, byteLen);
+
+    return GetBitfieldValue(bitfieldBytes, bitOffset, bitfieldWidth);
+}
+#endif
+
+uint8_t *GetInstrBufferStartPtr()
+{
+    return bufInstrStartPtr;
+}
+
+uint32_t GetBufferBitfieldValue(uint8_t *startPtr, uint32_t bitAddress, uint8_t bitfieldWidth)
+{
+    return GetBitfieldValue(startPtr, bitAddress, bitfieldWidth);
+}
+
 uint32_t GetInstrBitfieldValue(uint32_t bitAddress, uint8_t bitfieldWidth)
 {
     return GetBitfieldValue(bufInstrStartPtr, bitAddress, bitfieldWidth);
@@ -129,6 +193,10 @@ uint32_t GetInstrBitfieldValue(uint32_t bitAddress, uint8_t bitfieldWidth)
 
 uint32_t GetContextBitfieldValue(uint32_t bitAddress, uint8_t bitfieldWidth)
 {
+#ifdef GLOW_CONTEXT_PAGES
+    if (IsContextPaged()) return GetPagedBitfieldValue(bitAddress, bitfieldWidth);
+#endif
+
     return GetBitfieldValue(bufContextStartPtr, bitAddress, bitfieldWidth);
 }
 
@@ -147,7 +215,7 @@ uint32_t GetNextContextBitfieldValue(uint8_t bitfieldWidth)
 {
     if (bitfieldWidth == 0) return 0;   // handle case where opcode indicates absent value field.
 
-    uint32_t u32Val = GetBitfieldValue(bufContextStartPtr, bitContextIndex, bitfieldWidth);
+    uint32_t u32Val = GetContextBitfieldValue(bitContextIndex, bitfieldWidth);
 
     bitContextIndex += bitfieldWidth;
 
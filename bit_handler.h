@@ -8,6 +8,24 @@
 #ifndef BIT_HANDLER_H_
 #define BIT_HANDLER_H_
 
+/**
+ * Decoder state that is private to each path decoding thread.
+**/
+#ifdef GLOW_PATH_WORKERS
+#define GLOW_THREAD_LOCAL _Thread_local
+#else
+#define GLOW_THREAD_LOCAL
+#endif
+
+/**
+ * Per-field decode asserts, compiled out when every animation is verified at initialization.
+**/
+#ifdef GLOW_VERIFY_ANIMATION
+#define DecodeAssert(condition)
+#else
+#define DecodeAssert(condition) Assert(condition)
+#endif
+
 /**
  * Initialize bit handler with buffer address/size and reset bit pointer.
 **/
@@ -38,6 +56,13 @@ extern void FastForwardContextBits(uint32_t numBits);
 extern uint32_t GetInstrBitfieldValue(uint32_t bitAddress, uint8_t bitfieldWidth);
 extern uint32_t GetContextBitfieldValue(uint32_t bitAddress, uint8_t bitfieldWidth);
 
+/**
+ * Get value of N bits starting at bit address of the given buffer, without touching bit handler state.
+ * Lets worker threads decode bitfields of the instruction buffer concurrently.
+**/
+extern uint8_t *GetInstrBufferStartPtr();
+extern uint32_t GetBufferBitfieldValue(uint8_t *startPtr, uint32_t bitAddress, uint8_t bitfieldWidth);
+
 /**
  * Set value of N bits starting at buffer bit address.
 **/
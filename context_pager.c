@@ -0,0 +1,166 @@
+/*
+ *  Copyright 2018-2021 ledmaker.org
+ *
+ *  This file is part of Glow Decompiler Lib.
+ *
+ */
+
+#include "public_api.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef GLOW_CONTEXT_PAGES
+
+#include "bit_handler.h"
+#include "context_pager.h"
+#include "trace.h"
+
+#if GLOW_CONTEXT_PAGES > 254 || GLOW_CONTEXT_PAGES * GLOW_CONTEXT_PAGE_SZ >= SRAM_BUF_SZ
+#error "GLOW_CONTEXT_PAGES must be at most 254 and leave sram for instructions"
+#endif
+
+#define MAX_CONTEXT_PAGES ((UINT16_MAX + GLOW_CONTEXT_PAGE_SZ) / GLOW_CONTEXT_PAGE_SZ)
+#define NO_PAGE_SLOT 0xFF
+#define NO_PAGE 0xFFFF
+
+struct PageSlot
+{
+    uint16_t pageIdx;       // resident page, NO_PAGE if slot is free.
+    bool isDirty;           // page differs from its flash (or swap) copy.
+    bool isReferenced;      // page was accessed since the clock hand last passed it.
+};
+
+static struct PageSlot pageSlots[GLOW_CONTEXT_PAGES];
+static uint8_t pageSlotIdxs[MAX_CONTEXT_PAGES];                 // slot of each resident page, NO_PAGE_SLOT otherwise.
+static uint8_t swappedPages[(MAX_CONTEXT_PAGES + 7) / 8];       // pages whose latest copy is in swap rather than flash.
+static uint8_t clockHand;
+static uint32_t regionNvmAddr;
+static uint16_t regionByteLen;
+static bool isPaged = false;
+
+static uint8_t *GetSlotBytes(uint8_t slotIdx)
+{
+    return ptrSramBufferStart + (uint32_t)slotIdx * GLOW_CONTEXT_PAGE_SZ;
+}
+
+static uint16_t GetPageByteLen(uint16_t pageIdx)
+{
+    uint32_t pageByteAddress = (uint32_t)pageIdx * GLOW_CONTEXT_PAGE_SZ;
+
+    return (regionByteLen - pageByteAddress < GLOW_CONTEXT_PAGE_SZ) ? regionByteLen - pageByteAddress : GLOW_CONTEXT_PAGE_SZ;
+}
+
+static bool IsPageSwapped(uint16_t pageIdx)
+{
+    return swappedPages[pageIdx / 8] & (1 << (pageIdx % 8));
+}
+
+static uint8_t LoadPage(uint16_t pageIdx)
+{
+    // Pick victim slot, giving pages referenced since the last pass a second chance:
+    while (pageSlots[clockHand].isReferenced)
+    {
+        pageSlots[clockHand].isReferenced = false;
+        clockHand = (clockHand + 1) % GLOW_CONTEXT_PAGES;
+    }
+    uint8_t slotIdx = clockHand;
+    clockHand = (clockHand + 1) % GLOW_CONTEXT_PAGES;
+    struct PageSlot *ptrSlot = &pageSlots[slotIdx];
+
+    // Evict victim page, writing mutated counters back to swap:
+    if (ptrSlot->pageIdx != NO_PAGE)
+    {
+        if (ptrSlot->isDirty)
+        {
+            SwapWrite((uint32_t)ptrSlot->pageIdx * GLOW_CONTEXT_PAGE_SZ, GetSlotBytes(slotIdx), GetPageByteLen(ptrSlot->pageIdx));
+            swappedPages[ptrSlot->pageIdx / 8] |= 1 << (ptrSlot->pageIdx % 8);
+        }
+        pageSlotIdxs[ptrSlot->pageIdx] = NO_PAGE_SLOT;
+    }
+
+    // Load page from swap if it was ever written back, else from flash:
+    uint32_t pageByteAddress = (uint32_t)pageIdx * GLOW_CONTEXT_PAGE_SZ;
+    if (IsPageSwapped(pageIdx))
+    {
+        SwapRead(pageByteAddress, GetSlotBytes(slotIdx), GetPageByteLen(pageIdx));
+    }
+    else
+    {
+        TraceRecord(TraceFlashRead, TRACE_NO_PATH, 0, GetPageByteLen(pageIdx), regionNvmAddr + pageByteAddress);
+        FlashRead(regionNvmAddr + pageByteAddress, GetSlotBytes(slotIdx), GetPageByteLen(pageIdx));
+    }
+
+    ptrSlot->pageIdx = pageIdx;
+    ptrSlot->isDirty = false;
+    pageSlotIdxs[pageIdx] = slotIdx;
+
+    return slotIdx;
+}
+
+static uint8_t GetPageSlot(uint16_t pageIdx)
+{
+    uint8_t slotIdx = pageSlotIdxs[pageIdx];
+    if (slotIdx == NO_PAGE_SLOT) slotIdx = LoadPage(pageIdx);
+    pageSlots[slotIdx].isReferenced = true;
+
+    return slotIdx;
+}
+
+void InitContextPager(uint32_t nvmStartAddr, uint16_t contextRegionByteLen)
+{
+    regionNvmAddr = nvmStartAddr;
+    regionByteLen = contextRegionByteLen;
+
+    // Drop resident pages and swapped counters of any previous animation:
+    memset(pageSlotIdxs, NO_PAGE_SLOT, sizeof(pageSlotIdxs));
+    memset(swappedPages, 0, sizeof(swappedPages));
+    for (uint8_t slotIdx = 0; slotIdx < GLOW_CONTEXT_PAGES; slotIdx++)
+    {
+        pageSlots[slotIdx].pageIdx = NO_PAGE;
+        pageSlots[slotIdx].isDirty = false;
+        pageSlots[slotIdx].isReferenced = false;
+    }
+    clockHand = 0;
+    isPaged = true;
+}
+
+void StopContextPager()
+{
+    isPaged = false;
+}
+
+void ResumeContextPager()
+{
+    isPaged = true;
+}
+
+bool IsContextPaged()
+{
+    return isPaged;
+}
+
+void ReadContextPageBytes(uint32_t byteIdx, uint8_t *ptrBuffer, uint8_t byteLen)
+{
+    DecodeAssert(byteIdx + byteLen <= regionByteLen);
+
+    for (uint8_t idx = 0; idx < byteLen; idx++, byteIdx++)
+    {
+        ptrBuffer[idx] = GetSlotBytes(GetPageSlot(byteIdx / GLOW_CONTEXT_PAGE_SZ))[byteIdx % GLOW_CONTEXT_PAGE_SZ];
+    }
+}
+
+void WriteContextPageBytes(uint32_t byteIdx, const uint8_t *ptrBuffer, uint8_t byteLen)
+{
+    DecodeAssert(byteIdx + byteLen <= regionByteLen);
+
+    for (uint8_t idx = 0; idx < byteLen; idx++, byteIdx++)
+    {
+        uint8_t slotIdx = GetPageSlot(byteIdx / GLOW_CONTEXT_PAGE_SZ);
+        GetSlotBytes(slotIdx)[byteIdx % GLOW_CONTEXT_PAGE_SZ] = ptrBuffer[idx];
+        pageSlots[slotIdx].isDirty = true;
+    }
+}
+
+#endif
@@ -0,0 +1,57 @@
+/*
+ *  Copyright 2018-2021 ledmaker.org
+ *
+ *  This file is part of Glow Decompiler Lib.
+ *
+ */
+
+#ifndef CONTEXT_PAGER_H_
+#define CONTEXT_PAGER_H_
+
+#ifdef GLOW_CONTEXT_PAGES
+
+#ifndef GLOW_CONTEXT_PAGE_SZ
+#define GLOW_CONTEXT_PAGE_SZ 64
+#endif
+
+/**
+ * Byte size of the resident page slots, held at the start of the sram buffer while the metadata-region is paged.
+**/
+#define CONTEXT_PAGE_POOL_SZ ((uint32_t)GLOW_CONTEXT_PAGES * GLOW_CONTEXT_PAGE_SZ)
+
+/**
+ * Page the metadata-region of a ROM animation in from flash on demand, dropping all resident and swapped pages.
+ *
+ * param[in]: nvmStartAddr: flash start byte address of metadata-region.
+ * param[in]: contextRegionByteLen: byte length of metadata-region.
+**/
+extern void InitContextPager(uint32_t nvmStartAddr, uint16_t contextRegionByteLen);
+
+/**
+ * Stop paging, the metadata-region is resident in sram.
+**/
+extern void StopContextPager();
+
+/**
+ * Resume paging stopped by StopContextPager, keeping resident and swapped pages.
+**/
+extern void ResumeContextPager();
+
+/**
+ * Check whether the metadata-region is paged.
+**/
+extern bool IsContextPaged();
+
+/**
+ * Copy bytes of the paged metadata-region, loading pages that are not resident.
+**/
+extern void ReadContextPageBytes(uint32_t byteIdx, uint8_t *ptrBuffer, uint8_t byteLen);
+
+/**
+ * Overwrite bytes of the paged metadata-region and mark their pages dirty.
+**/
+extern void WriteContextPageBytes(uint32_t byteIdx, const uint8_t *ptrBuffer, uint8_t byteLen);
+
+#endif
+
+#endif /* CONTEXT_PAGER_H_ */
@@ -9,17 +9,24 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
+#include "bit_handler.h"
 #include "decode_instruction.h"
 #include "decode_metadata.h"
-#include "bit_handler.h"
 #include "ledstrip_buffer.h"
+#include "parallel_apply.h"
+#include "parallel_paths.h"
+#include "render_ahead.h"
+#include "trace.h"
 
 #define RED_MASK 0x08
 #define GREEN_MASK 0x04
 #define BLUE_MASK 0x02
 #define BRIGHT_MASK 0x01
+#define ALL_COLORS_MASK 0x0F
 
 #define BITS_PER_BYTE 8
+#define MASK_BITS_PER_READ 32
 #define BIT_BYTE_SHIFT 3
 
 typedef enum
@@ -30,24 +37,290 @@ typedef enum
     SetValRandom = 3
 } ActionOpcode;
 
+typedef enum
+{
+    Spans = 0,          // (start, length) led ranges.
+    StridedSpans = 1    // (start, length, stride, repeats) led ranges.
+} MaskEncoding;
+
+static uint32_t MixRandomBits(uint32_t u32Val)
+{
+    // Integer hash finalizer, every input bit affects every output bit:
+    u32Val ^= u32Val >> 16;
+    u32Val *= 0x7FEB352D;
+    u32Val ^= u32Val >> 15;
+    u32Val *= 0x846CA68B;
+    u32Val ^= u32Val >> 16;
+    return u32Val;
+}
+
+static uint32_t GetRandomKey()
+{
+    // Key random values on seed, tick, path and instruction so that they do not depend on decode order:
+    uint32_t randomKey = MixRandomBits(gContext.randomSeed ^ 0x9E3779B9);
+    randomKey = MixRandomBits(randomKey ^ gContext.tickCount);
+    randomKey = MixRandomBits(randomKey ^ pContext.pathIdx_Value);
+    return MixRandomBits(randomKey ^ GetCurrentInstrBitAddress());
+}
+
+static struct Led GetRandomLedColor(uint32_t randomKey, uint32_t ledIdx)
+{
+    uint32_t randomBits = MixRandomBits(randomKey + ledIdx * 0x9E3779B9);
+    struct Led color = { .red = randomBits, .green = randomBits >> 8, .blue = randomBits >> 16, .bright = (randomBits >> 24) & 0x1F };
+    return color;
+}
+
+static void FillLedRangeRandom(uint8_t colorBitmap, uint32_t randomKey, uint32_t startLedIdx, uint32_t numLeds)
+{
+#ifdef GLOW_PATH_WORKERS
+    if (activeLayer)
+    {
+        for (uint32_t ledIdx = startLedIdx; ledIdx < startLedIdx + numLeds; ledIdx++)
+        {
+            SetLayerLedColor(activeLayer, ledIdx, colorBitmap, GetRandomLedColor(randomKey, ledIdx));
+        }
+        return;
+    }
+#endif
+
+    if (colorBitmap && numLeds)
+    {
+        ledstripBuffer.isDirty = true;
+    }
+
+    // Each led's random value depends only on its index, so whole ranges fill without a serial generator state:
+    if (colorBitmap == ALL_COLORS_MASK)
+    {
+        for (uint32_t ledIdx = startLedIdx; ledIdx < startLedIdx + numLeds; ledIdx++)
+        {
+            struct Led color = GetRandomLedColor(randomKey, ledIdx);
+            SetLed(ledIdx, color);
+        }
+        return;
+    }
+    for (uint32_t ledIdx = startLedIdx; ledIdx < startLedIdx + numLeds; ledIdx++)
+    {
+        struct Led color = GetRandomLedColor(randomKey, ledIdx);
+        if (colorBitmap & RED_MASK) LedRed(ledIdx) = color.red;
+        if (colorBitmap & GREEN_MASK) LedGreen(ledIdx) = color.green;
+        if (colorBitmap & BLUE_MASK) LedBlue(ledIdx) = color.blue;
+        if (colorBitmap & BRIGHT_MASK) LedBright(ledIdx) = color.bright;
+    }
+}
+
+static void FillLedRange(uint8_t colorBitmap, struct Led color, const uint32_t *ptrRandomKey, uint32_t startLedIdx, uint32_t numLeds)
+{
+    DecodeAssert(startLedIdx + numLeds <= ledstripBuffer.numLeds);
+
+    if (ptrRandomKey)
+    {
+        FillLedRangeRandom(colorBitmap, *ptrRandomKey, startLedIdx, numLeds);
+        return;
+    }
+
+#ifdef GLOW_PATH_WORKERS
+    if (activeLayer)
+    {
+        SetLayerLedRange(activeLayer, startLedIdx, numLeds, colorBitmap, color);
+        return;
+    }
+#endif
+
+    if (colorBitmap && numLeds)
+    {
+        ledstripBuffer.isDirty = true;
+    }
+
+#ifdef GLOW_PLANAR_LEDS
+    // Each color channel of the led range is contiguous:
+    if (colorBitmap & RED_MASK) memset(planarLeds.red + startLedIdx, color.red, numLeds);
+    if (colorBitmap & GREEN_MASK) memset(planarLeds.green + startLedIdx, color.green, numLeds);
+    if (colorBitmap & BLUE_MASK) memset(planarLeds.blue + startLedIdx, color.blue, numLeds);
+    if (colorBitmap & BRIGHT_MASK) memset(planarLeds.bright + startLedIdx, color.bright, numLeds);
+#else
+    struct Led *ptrLeds = ledstripBuffer.leds + startLedIdx;
+
+    // Fill each affected color channel of the led range:
+    if (colorBitmap == ALL_COLORS_MASK)
+    {
+        for (uint32_t ledIdx = 0; ledIdx < numLeds; ledIdx++) ptrLeds[ledIdx] = color;
+        return;
+    }
+    if (colorBitmap & RED_MASK)
+    {
+        for (uint32_t ledIdx = 0; ledIdx < numLeds; ledIdx++) ptrLeds[ledIdx].red = color.red;
+    }
+    if (colorBitmap & GREEN_MASK)
+    {
+        for (uint32_t ledIdx = 0; ledIdx < numLeds; ledIdx++) ptrLeds[ledIdx].green = color.green;
+    }
+    if (colorBitmap & BLUE_MASK)
+    {
+        for (uint32_t ledIdx = 0; ledIdx < numLeds; ledIdx++) ptrLeds[ledIdx].blue = color.blue;
+    }
+    if (colorBitmap & BRIGHT_MASK)
+    {
+        for (uint32_t ledIdx = 0; ledIdx < numLeds; ledIdx++) ptrLeds[ledIdx].bright = color.bright;
+    }
+#endif
+}
+
+static void ApplyBitmapMask(uint8_t colorBitmap, struct Led color, const uint32_t *ptrRandomKey)
+{
+    if (ptrRandomKey)
+    {
+        uint32_t runStartLedIdx = 0, runLen = 0;
+
+        // Read mask bits up to 32 leds at a time (first led in most significant bit), filling runs of active leds at once:
+        for (uint32_t ledIdx = 0; ledIdx < ledstripBuffer.numLeds; ledIdx += MASK_BITS_PER_READ)
+        {
+            uint8_t numBits = (ledstripBuffer.numLeds - ledIdx < MASK_BITS_PER_READ) ? ledstripBuffer.numLeds - ledIdx : MASK_BITS_PER_READ;
+            uint32_t maskBits = GetNextInstrBitfieldValue(numBits);
+            if (maskBits == UINT32_MAX >> (MASK_BITS_PER_READ - numBits))
+            {
+                if (!runLen) runStartLedIdx = ledIdx;
+                runLen += numBits;
+                continue;
+            }
+
+            for (uint8_t bitIdx = 0; bitIdx < numBits; bitIdx++)
+            {
+                if (maskBits & ((uint32_t)1 << (numBits - 1 - bitIdx)))
+                {
+                    if (!runLen) runStartLedIdx = ledIdx + bitIdx;
+                    runLen++;
+                }
+                else if (runLen)
+                {
+                    FillLedRange(colorBitmap, color, ptrRandomKey, runStartLedIdx, runLen);
+                    runLen = 0;
+                }
+            }
+        }
+        if (runLen) FillLedRange(colorBitmap, color, ptrRandomKey, runStartLedIdx, runLen);
+        return;
+    }
+
+#ifdef GLOW_PATH_WORKERS
+    if (activeLayer)
+    {
+        for (uint16_t ledIdx = 0; ledIdx < ledstripBuffer.numLeds; ledIdx++)
+        {
+            if (GetNextInstrBitfieldValue(1)) SetLayerLedColor(activeLayer, ledIdx, colorBitmap, color);
+        }
+        return;
+    }
+#endif
+
+#ifdef GLOW_APPLY_WORKERS
+    if (ledstripBuffer.numLeds >= GLOW_PARALLEL_APPLY_MIN_LEDS && StartApplyWorkers())
+    {
+        // Each led's mask bit is at a known offset from the mask start, so split leds across worker threads:
+        if (ApplyBitmapMaskParallel(colorBitmap, color, GetCurrentInstrBitAddress()) && colorBitmap)
+        {
+            ledstripBuffer.isDirty = true;
+        }
+        FastForwardInstrBits(ledstripBuffer.numLeds);
+        return;
+    }
+#endif
+
+    for (uint16_t ledIdx = 0; ledIdx < ledstripBuffer.numLeds; ledIdx++)
+    {
+        bool isLedActive = (bool)GetNextInstrBitfieldValue(1);
+        if (!isLedActive) continue;
+
+        if (colorBitmap & RED_MASK)
+        {
+            LedRed(ledIdx) = color.red;
+        }
+        if (colorBitmap & GREEN_MASK)
+        {
+            LedGreen(ledIdx) = color.green;
+        }
+        if (colorBitmap & BLUE_MASK)
+        {
+            LedBlue(ledIdx) = color.blue;
+        }
+        if (colorBitmap & BRIGHT_MASK)
+        {
+            LedBright(ledIdx) = color.bright;
+        }
+        if (colorBitmap)
+        {
+            ledstripBuffer.isDirty = true;
+        }
+    }
+}
+
+static void ApplySpanMask(uint8_t colorBitmap, struct Led color, const uint32_t *ptrRandomKey)
+{
+    MaskEncoding maskEncoding = GetNextInstrBitfieldValue(2);
+    uint8_t numSpans = GetNextInstrBitfieldValue(8);
+
+    for (uint8_t spanIdx = 0; spanIdx < numSpans; spanIdx++)
+    {
+        uint32_t startLedIdx = GetNextInstrBitfieldValue(16);
+        uint32_t numLeds = GetNextInstrBitfieldValue(16);
+        uint32_t ledStride = 0, numRepeats = 1;
+        if (maskEncoding == StridedSpans)
+        {
+            ledStride = GetNextInstrBitfieldValue(16);
+            numRepeats = GetNextInstrBitfieldValue(16);
+        }
+
+        // Skip span whose last repeat ends past the ledstrip, rather than fill past the led buffer:
+        if (numLeds == 0 || numRepeats == 0) continue;
+        if (startLedIdx + (uint64_t)(numRepeats - 1) * ledStride + numLeds > ledstripBuffer.numLeds)
+        {
+            DecodeAssert(false);
+            continue;
+        }
+
+        for (uint32_t repeatIdx = 0; repeatIdx < numRepeats; repeatIdx++)
+        {
+            FillLedRange(colorBitmap, color, ptrRandomKey, startLedIdx + repeatIdx * ledStride, numLeds);
+        }
+    }
+}
+
+static void ApplyLedMask(uint8_t colorBitmap, struct Led color, const uint32_t *ptrRandomKey, bool isSpanMask)
+{
+    if (isSpanMask) ApplySpanMask(colorBitmap, color, ptrRandomKey);
+    else ApplyBitmapMask(colorBitmap, color, ptrRandomKey);
+}
+
 bool ProcessPathActivate()
 {
     // Set specified path as runnable, the path's pause-ticks and instr-bit-addr should already be reset:
     uint8_t pathIdx = (uint8_t)GetNextInstrBitfieldValue(8);
-    SetContextBitfieldValue(pContext.isEndedBitfield_BitAddress + pathIdx, 1, false);
+#ifdef GLOW_PATH_WORKERS
+    if (activeLayer)
+    {
+        DeferPathActivate(activeLayer, pathIdx);   // applied in path index order once layers are composed.
+        return false;
+    }
+#endif
+    SetPathEnded(pathIdx, false);
 
     return false;   // return unblocked.
 }
 
-bool ProcessGlowImmediate()
+bool ProcessGlowImmediate(bool isSpanMask)
 {
     uint8_t colorBitmap = GetNextInstrBitfieldValue(4);
     ActionOpcode actionOpcode = GetNextInstrBitfieldValue(2);
 
-    bool isNewRed = false, isNewGreen = false, isNewBlue = false, isNewBright = false;
-
     if (actionOpcode == SetAllZeroThenVal)	// turn all leds off then set absolute color value(s).
     {
+#ifdef GLOW_PATH_WORKERS
+        if (activeLayer) ClearLayer(activeLayer);
+        else
+#endif
+#ifdef GLOW_RENDER_AHEAD_FRAMES
+        if (IsRenderAheadProducer()) ClearLedstripBuffer();     // only the consumer thread pushes to ledstrip.
+        else
+#endif
         SetLedstripTestColor(0, 0, 0, 0);
         actionOpcode = SetVal;
     }
@@ -57,57 +330,35 @@ bool ProcessGlowImmediate()
         uint8_t red = 0, green = 0, blue = 0, bright = 0;
         if (colorBitmap & RED_MASK)
         {
-            isNewRed = true;
             red = GetNextInstrBitfieldValue(8);
         }
         if (colorBitmap & GREEN_MASK)
         {
-            isNewGreen = true;
             green = GetNextInstrBitfieldValue(8);
         }
         if (colorBitmap & BLUE_MASK)
         {
-            isNewBlue = true;
             blue = GetNextInstrBitfieldValue(8);
         }
         if (colorBitmap & BRIGHT_MASK)
         {
-            isNewBright = true;
             bright = GetNextInstrBitfieldValue(5);
         }
 
-        for (uint16_t ledIdx = 0; ledIdx < ledstripBuffer.numLeds; ledIdx++)
-        {
-            bool isLedActive = (bool)GetNextInstrBitfieldValue(1);
-            if (!isLedActive) continue;
-
-            if (isNewRed)
-            {
-                ledstripBuffer.leds[ledIdx].red = red;
-            }
-            if (isNewGreen)
-            {
-                ledstripBuffer.leds[ledIdx].green = green;
-            }
-            if (isNewBlue)
-            {
-                ledstripBuffer.leds[ledIdx].blue = blue;
-            }
-            if (isNewBright)
-            {
-                ledstripBuffer.leds[ledIdx].bright = bright;
-            }
-            if (isNewRed || isNewGreen || isNewBlue || isNewBright)
-            {
-				ledstripBuffer.isDirty = true;
-            }
-        }
+        struct Led color = { .red = red, .green = green, .blue = blue, .bright = bright };
+        ApplyLedMask(colorBitmap, color, NULL, isSpanMask);
+    }
+    else if (actionOpcode == SetValRandom)	// set random value(s), drawn per led.
+    {
+        uint32_t randomKey = GetRandomKey();
+        struct Led color = { 0 };
+        ApplyLedMask(colorBitmap, color, &randomKey, isSpanMask);
     }
 
     return false;   // return unblocked.
 }
 
-bool ProcessGlowRamp()
+bool ProcessGlowRamp(bool isSpanMask)
 {
     uint32_t glowRampStartBitAddress = GetCurrentInstrBitAddress() - 4;
     uint8_t tickOpcode = GetNextInstrBitfieldValue(2);
@@ -120,13 +371,11 @@ bool ProcessGlowRamp()
     pContext.extraValue_Value = rampTicksCounter + 1;
     SetContextBitfieldValue(pContext.extraValueBitfield_BitAddress, pContext.extraValueBitfield_BitWidth, pContext.extraValue_Value);
 
-	bool isNewRed = false, isNewGreen = false, isNewBlue = false, isNewBright = false;
 	uint8_t incDecOp, redColorVal = 0, greenColorVal = 0, blueColorVal = 0, brightColorVal = 0, colorStep, colorOffset;
 	uint32_t tickStep;
 
 	if (colorBitmap & RED_MASK)
     {
-		isNewRed = true;
 		redColorVal = GetNextInstrBitfieldValue(8);  // start of ramp color.
 		incDecOp = GetNextInstrBitfieldValue(2);
 		if (incDecOp)
@@ -150,7 +399,6 @@ bool ProcessGlowRamp()
 
     if (colorBitmap & GREEN_MASK)
     {
-		isNewGreen = true;
 		greenColorVal = GetNextInstrBitfieldValue(8);  // start of ramp color.
 		incDecOp = GetNextInstrBitfieldValue(2);
 		if (incDecOp)
@@ -174,7 +422,6 @@ bool ProcessGlowRamp()
 
     if (colorBitmap & BLUE_MASK)
     {
-		isNewBlue = true;
 		blueColorVal = GetNextInstrBitfieldValue(8);  // start of ramp color.
 		incDecOp = GetNextInstrBitfieldValue(2);
 		if (incDecOp)
@@ -198,7 +445,6 @@ bool ProcessGlowRamp()
 
     if (colorBitmap & BRIGHT_MASK)
     {
-		isNewBright = true;
 		brightColorVal = GetNextInstrBitfieldValue(8);  // start of ramp color.
 		incDecOp = GetNextInstrBitfieldValue(2);
 		if (incDecOp)
@@ -221,36 +467,10 @@ bool ProcessGlowRamp()
     }
 
     // Apply RGBW values to all affected leds:
-    for (int ledIdx = 0; ledIdx < ledstripBuffer.numLeds; ledIdx++)
-    {
-        bool isLedActive = (bool)GetNextInstrBitfieldValue(1);
-        if (!isLedActive) continue;
-
-        if (isNewRed)
-        {
-            ledstripBuffer.leds[ledIdx].red = redColorVal;
-        }
-
-        if (isNewGreen)
-        {
-            ledstripBuffer.leds[ledIdx].green = greenColorVal;
-        }
-
-        if (isNewBlue)
-        {
-            ledstripBuffer.leds[ledIdx].blue = blueColorVal;
-        }
-
-        if (isNewBright)
-        {
-            ledstripBuffer.leds[ledIdx].bright = brightColorVal;
-        }
+    struct Led color = { .red = redColorVal, .green = greenColorVal, .blue = blueColorVal, .bright = brightColorVal };
+    ApplyLedMask(colorBitmap, color, NULL, isSpanMask);
 
-		if (isNewRed || isNewGreen || isNewBlue || isNewBright)
-		{
-			ledstripBuffer.isDirty = true;
-		}
-    }
+    if (rampTicksCounter == 0) TraceRecord(TraceRampStart, pContext.pathIdx_Value, 0, glowRampStartBitAddress, rampTicksVal);
 
     if (rampTicksCounter++ < rampTicksVal)
     {
@@ -264,6 +484,8 @@ bool ProcessGlowRamp()
         return true;    // return blocked flag (paused).
     }
 
+    TraceRecord(TraceRampEnd, pContext.pathIdx_Value, 0, glowRampStartBitAddress, 0);
+
     return false;   // return unblocked flag (ramp instr completed).
 }
 
@@ -273,6 +495,8 @@ bool ProcessPause()
     pContext.pauseTicks_Value = GetNextInstrBitfieldValue((tickOpcode + 1) * BITS_PER_BYTE);
     SetContextBitfieldValue(pContext.pauseTicksBitfield_BitAddress, pContext.pauseTicksBitfield_BitWidth, pContext.pauseTicks_Value);
 
+    TraceRecord(TracePauseStart, pContext.pathIdx_Value, 0, GetCurrentInstrBitAddress(), pContext.pauseTicks_Value);
+
     // Save current bit address to start of path in readiness for pause completion:
     pContext.instrBitAddress_Value = GetCurrentInstrBitAddress();
     SetContextBitfieldValue(pContext.instrBitAddressBitfield_BitAddress, pContext.instrBitAddressBitfield_BitWidth, pContext.instrBitAddress_Value);
@@ -293,7 +517,7 @@ bool ProcessPathEnd()
 {
     // Set is-ended bit:
     pContext.isEnded_Value = 1;
-    SetContextBitfieldValue(pContext.isEndedBitfield_BitAddress + pContext.pathIdx_Value, 1, pContext.isEnded_Value);
+    SetPathEnded(pContext.pathIdx_Value, pContext.isEnded_Value);
 
     // Clear pause ticks in readiness for subsequent path activation:
     pContext.pauseTicks_Value = 0;
@@ -309,38 +533,50 @@ bool ProcessPathEnd()
 bool ProcessNextInstruction()
 {
     bool isBlocked = false;
-    gContext.currInstr = GetNextInstrBitfieldValue(4);
+    pContext.currInstr = GetNextInstrBitfieldValue(4);
+    TraceRecord(TraceInstr, pContext.pathIdx_Value, pContext.currInstr, GetCurrentInstrBitAddress() - 4, 0);
 
-    if (gContext.currInstr == Pc2Dev_PathActivate)
+    if (pContext.currInstr == Pc2Dev_PathActivate)
     {
         ProcessPathActivate();
         isBlocked = false;
     }
-    else if (gContext.currInstr == Pc2Dev_GlowImmediate)
+    else if (pContext.currInstr == Pc2Dev_GlowImmediate)
+    {
+        ProcessGlowImmediate(false);
+        isBlocked = false;
+    }
+    else if (pContext.currInstr == Pc2Dev_GlowRamp)
+    {
+        isBlocked = ProcessGlowRamp(false);
+    }
+#if GLOW_PROTOCOL_VERSION >= SPAN_MASK_PROTOCOL_VERSION
+    else if (pContext.currInstr == Pc2Dev_GlowImmediateSpans)
     {
-        ProcessGlowImmediate();
+        ProcessGlowImmediate(true);
         isBlocked = false;
     }
-    else if (gContext.currInstr == Pc2Dev_GlowRamp)
+    else if (pContext.currInstr == Pc2Dev_GlowRampSpans)
     {
-        isBlocked = ProcessGlowRamp();
+        isBlocked = ProcessGlowRamp(true);
     }
-    else if (gContext.currInstr == Pc2Dev_Pause)
+#endif
+    else if (pContext.currInstr == Pc2Dev_Pause)
     {
         ProcessPause();
         isBlocked = true;
     }
-    else if (gContext.currInstr == Pc2Dev_Here)
+    else if (pContext.currInstr == Pc2Dev_Here)
     {
         // skip over 'here' instruction.
         isBlocked = false;
     }
-    else if (gContext.currInstr == Pc2Dev_Goto)
+    else if (pContext.currInstr == Pc2Dev_Goto)
     {
         ProcessGoto();
         isBlocked = false;
     }
-    else if (gContext.currInstr == Pc2Dev_PathEnd)
+    else if (pContext.currInstr == Pc2Dev_PathEnd)
     {
         ProcessPathEnd();
         isBlocked = true;
@@ -11,6 +11,9 @@
 #define BITS_PER_BYTE 8
 #define BIT_BYTE_SHIFT 3
 
+// First protocol version with span-encoded led mask instructions:
+#define SPAN_MASK_PROTOCOL_VERSION 2
+
 extern bool ProcessNextInstruction();
 
 #endif /* DECODE_INSTR_H_ */
\ No newline at end of file
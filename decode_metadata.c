@@ -10,40 +10,103 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 #include "bit_handler.h"
+#include "context_pager.h"
 #include "decode_instruction.h"
 #include "decode_metadata.h"
 #include "ledstrip_buffer.h"
+#include "parallel_paths.h"
+#include "trace.h"
+#include "unpack_instruction.h"
+#include "verify_animation.h"
 
 #define BITS_PER_BYTE 8
 #define BIT_BYTE_SHIFT 3
 
+#if defined(__GNUC__)
+#define CountTrailingZeros(u64Val) __builtin_ctzll(u64Val)
+#else
+static uint8_t CountTrailingZeros(uint64_t u64Val)
+{
+	uint8_t numZeros = 0;
+	while (!(u64Val & 1)) { u64Val >>= 1; numZeros++; }
+	return numZeros;
+}
+#endif
+
 volatile struct GlobalContext gContext;
-volatile struct PathContext pContext;
+GLOW_THREAD_LOCAL volatile struct PathContext pContext;
 
-bool InitAnimation(bool isSaveToRom)
+static const uint8_t fieldPrefixBitWidths[NUM_PATH_FIELDS] = { 2, 2, 2, 3, 3 };	// width opcode preceding each field.
+
+static uint64_t activePaths[MAX_PATHS / PATHS_PER_WORD];	// native copy of path-ended bitfield, set bit means not ended.
+static struct PathBlockIndex pathBlocks[MAX_PATHS];
+
+static uint8_t GetFieldBitWidth(const struct PathBlockIndex *ptrBlock, uint8_t fieldIdx)
 {
-	gContext.ptrSram = ptrSramBufferStart;  // set pointer to start of allocated sram region
+	return ((ptrBlock->fieldByteLens >> (fieldIdx * FIELD_BYTE_LEN_BITS)) & ((1 << FIELD_BYTE_LEN_BITS) - 1)) * BITS_PER_BYTE;
+}
 
-#ifdef NVM_BUF_START_ADDR
-	if (isSaveToRom)
+static void IndexPathContexts()
+{
+	SetCurrentContextBitAddress(gContext.firstContextBlock_BitAddress);
+	for (uint8_t wordIdx = 0; wordIdx < MAX_PATHS / PATHS_PER_WORD; wordIdx++) activePaths[wordIdx] = 0;
+
+	for (uint16_t pathIdx = 0; pathIdx < gContext.totalPaths_Value; pathIdx++)
 	{
-		// Load known portion of metadata-region common data into sram:
-		gContext.ptrNvm = NVM_BUF_START_ADDR;  // set pointer to start of allocated sram region.
-		FlashRead(gContext.ptrNvm, gContext.ptrSram, 14);    // read first 14 bytes.
+		pathBlocks[pathIdx].blockBitAddress = GetCurrentContextBitAddress();
+		pathBlocks[pathIdx].fieldByteLens = 0;
+
+		// Decode width of path start-byte address, byte length and instruction bit address (1-4 bytes),
+		// then of extra value and pause-ticks (0-7 bytes), skipping each field:
+		for (uint8_t fieldIdx = 0; fieldIdx < NUM_PATH_FIELDS; fieldIdx++)
+		{
+			uint8_t tickOpcode = GetNextContextBitfieldValue(fieldPrefixBitWidths[fieldIdx]);
+			uint8_t fieldByteLen = (fieldIdx < ExtraValueField) ? tickOpcode + 1 : tickOpcode;
+			pathBlocks[pathIdx].fieldByteLens |= (uint16_t)fieldByteLen << (fieldIdx * FIELD_BYTE_LEN_BITS);
+			FastForwardContextBits(fieldByteLen * BITS_PER_BYTE);
+		}
+
+		if (!GetContextBitfieldValue(pContext.isEndedBitfield_BitAddress + pathIdx, 1))
+		{
+			activePaths[pathIdx / PATHS_PER_WORD] |= (uint64_t)1 << (pathIdx % PATHS_PER_WORD);
+		}
 	}
+}
+
+void SetRandomSeed(uint32_t seed)
+{
+	gContext.randomSeed = seed;
+}
+
+bool InitAnimation(bool isSaveToRom)
+{
+#ifdef NVM_BUF_START_ADDR
+	gContext.nvmStartAddr = NVM_BUF_START_ADDR;
 #endif
 
-	// Initialize metadata-region bit handler to start of sram-region:
-	InitContextBitHandler(ptrSramBufferStart);
+	if (!LoadAnimationContext(isSaveToRom, false))
+	{
+		return false;
+	}
 
-	// Read metadata-region common data:
-	if (GetNextContextBitfieldValue(4) != Pc2Dev_ContextRegion)
+	SetLedstripTestColor(0, 0, 0, 0);   // turn off all leds.
+
+    return true;
+}
+
+bool DecodeContextCommonData(bool isSaveToRom)
+{
+	uint8_t contextRegionOpcode = GetNextContextBitfieldValue(4);
+	if (contextRegionOpcode != Pc2Dev_ContextRegion && !(isSaveToRom && contextRegionOpcode == Pc2Dev_PackedContextRegion))
 	{
-		return false; // abort if invalid/missing metadata-region.
+		return false; // abort if invalid/missing metadata-region (packed instruction region is ROM only).
 	}
+	gContext.isInstrRegionPacked = (contextRegionOpcode == Pc2Dev_PackedContextRegion);
 
 	gContext.contextRegionByteLen_Value = GetNextContextBitfieldValue(16);
+	gContext.contextSramByteLen = gContext.contextRegionByteLen_Value;
 	gContext.instrRegionByteLen_Value = GetNextContextBitfieldValue(32);
 	gContext.totalLeds_Value = GetNextContextBitfieldValue(16);
 	gContext.tickIntervalMs_Value = GetNextContextBitfieldValue(16);
@@ -52,8 +115,50 @@ bool InitAnimation(bool isSaveToRom)
 	pContext.isEndedBitfield_BitAddress = GetCurrentContextBitAddress();
 	FastForwardContextBits(gContext.totalPaths_Value); // move bit handler past path-end bitmap to first metadata-block.
 	gContext.firstContextBlock_BitAddress = GetCurrentContextBitAddress();  // save bit address of first metadata-block.
-	gContext.nextContextBlock_BitAddress = gContext.firstContextBlock_BitAddress;
+
+	return true;
+}
+
+bool LoadAnimationContext(bool isSaveToRom, bool isContextCached)
+{
+	gContext.ptrSram = ptrSramBufferStart;  // set pointer to start of allocated sram region
+
+#ifdef NVM_BUF_START_ADDR
+	if (isSaveToRom && !isContextCached)
+	{
+		// Load known portion of metadata-region common data into sram:
+		gContext.ptrNvm = gContext.nvmStartAddr;  // set pointer to start of animation's flash region.
+		TraceRecord(TraceFlashRead, TRACE_NO_PATH, 0, 14, gContext.ptrNvm);
+		FlashRead(gContext.ptrNvm, gContext.ptrSram, 14);    // read first 14 bytes.
+	}
+#endif
+
+	// Initialize metadata-region bit handler to start of sram-region:
+	InitContextBitHandler(ptrSramBufferStart);
+#ifdef GLOW_CONTEXT_PAGES
+	StopContextPager();  // common data is read from sram until metadata-region length is known.
+#endif
+
+	// Read metadata-region common data:
+	if (!DecodeContextCommonData(isSaveToRom))
+	{
+		return false; // abort if invalid/missing metadata-region.
+	}
+#ifdef GLOW_CONTEXT_PAGES
+	if (isSaveToRom && !isContextCached && gContext.contextRegionByteLen_Value > CONTEXT_PAGE_POOL_SZ)
+	{
+		// Page metadata-region in from flash on demand instead of caching all of it in sram:
+		InitContextPager(gContext.nvmStartAddr, gContext.contextRegionByteLen_Value);
+		gContext.contextSramByteLen = CONTEXT_PAGE_POOL_SZ;
+	}
+#endif
+	int32_t sramInstrByteLen = (int32_t)SRAM_BUF_SZ - gContext.contextSramByteLen;	// sram bytes left for path instructions.
+	if (sramInstrByteLen < 0)
+	{
+		return false; // abort if metadata-region cannot be cached in sram.
+	}
 	pContext.pathIdx_Value = 0;  // initialize path idx.
+	gContext.tickCount = 0;  // restart random value sequence.
 
     // Reset path-ended bitfield in common metadata:
     //pContext.isEnded_Value = 0;
@@ -69,104 +174,219 @@ bool InitAnimation(bool isSaveToRom)
 	SaveBrightnessCoefficient(gContext.simBrightCoeff_Value);
 
 #ifdef NVM_BUF_START_ADDR
-	if (isSaveToRom)
+	if (isSaveToRom && !isContextCached && gContext.contextSramByteLen == gContext.contextRegionByteLen_Value)
 	{
 		// Load entire metadata region into sram now that its length is known:
-		FlashRead(NVM_BUF_START_ADDR, gContext.ptrSram, gContext.contextRegionByteLen_Value);
+		TraceRecord(TraceFlashRead, TRACE_NO_PATH, 0, gContext.contextRegionByteLen_Value, gContext.nvmStartAddr);
+		FlashRead(gContext.nvmStartAddr, gContext.ptrSram, gContext.contextRegionByteLen_Value);
+	}
+#endif
+
+#ifdef GLOW_VERIFY_ANIMATION
+	// Verify entire animation once so that it can be decoded without per-field checks (cached metadata-regions are
+	// verified path by path while the playlist stages them):
+	if (!isContextCached && !VerifyAnimation(isSaveToRom))
+	{
+		return false; // abort if animation cannot be safely decoded.
 	}
 #endif
 
+	// Locate each path's metadata-block and load active paths:
+	IndexPathContexts();
+
 	// Other initialization:
-	InitInstrBitHandler(ptrSramBufferStart + gContext.contextRegionByteLen_Value); // initialize sram bit handler to start of first instr path.
-	SetLedstripTestColor(0, 0, 0, 0);   // turn off all leds.
+	InitInstrBitHandler(ptrSramBufferStart + gContext.contextSramByteLen); // initialize sram bit handler to start of first instr path.
 
     return true;
 }
 
-bool RunAnimation(bool isSaveToRom)
+#ifdef NVM_BUF_START_ADDR
+uint32_t LoadPathInstructions(uint32_t pathStartByteAddress, uint32_t pathByteLen)
 {
-	do
+	gContext.ptrNvm = gContext.nvmStartAddr + gContext.contextRegionByteLen_Value + pathStartByteAddress;  // flash start byte of path.
+	gContext.ptrSram = ptrSramBufferStart + gContext.contextSramByteLen;
+
+	if (gContext.isInstrRegionPacked)
 	{
-		// Process next metadata-block data...
+		// Stream packed path into sram region following metadata-region:
+		return UnpackInstrPath(gContext.ptrNvm, pathByteLen, gContext.ptrSram, SRAM_BUF_SZ - gContext.contextSramByteLen);
+	}
+
+	TraceRecord(TraceFlashRead, pContext.pathIdx_Value, 0, pathByteLen, gContext.ptrNvm);
+	FlashRead(gContext.ptrNvm, gContext.ptrSram, pathByteLen);
+
+	return pathByteLen;
+}
+#endif
 
-		// Get current path's is-ended value:
-		pContext.isEnded_Value = GetContextBitfieldValue(pContext.isEndedBitfield_BitAddress + pContext.pathIdx_Value, 1);
+void SetPathEnded(uint8_t pathIdx, bool isEnded)
+{
+	uint64_t pathBit = (uint64_t)1 << (pathIdx % PATHS_PER_WORD);
 
-		// Switch bit handler to start of metadata-region:
-		SetCurrentContextBitAddress(gContext.nextContextBlock_BitAddress);
-		// Get current path's start-byte address:
-		uint8_t tickOpcode = GetNextContextBitfieldValue(2);
-		pContext.pathStartByteAddress_Value = GetNextContextBitfieldValue((tickOpcode + 1) * BITS_PER_BYTE);
+	SetContextBitfieldValue(pContext.isEndedBitfield_BitAddress + pathIdx, 1, isEnded);
 
-		if (!isSaveToRom)
-		{
-			// Reinit instruction bit handler to start of each instruction path (since instr bit addr is relative to start of current instr path):
-			InitInstrBitHandler(ptrSramBufferStart + gContext.contextRegionByteLen_Value + pContext.pathStartByteAddress_Value);
-		}
+#ifdef GLOW_PATH_WORKERS
+	// Paths decoded in parallel end themselves concurrently:
+	if (isEnded) __atomic_fetch_and(&activePaths[pathIdx / PATHS_PER_WORD], ~pathBit, __ATOMIC_RELAXED);
+	else __atomic_fetch_or(&activePaths[pathIdx / PATHS_PER_WORD], pathBit, __ATOMIC_RELAXED);
+#else
+	if (isEnded) activePaths[pathIdx / PATHS_PER_WORD] &= ~pathBit;
+	else activePaths[pathIdx / PATHS_PER_WORD] |= pathBit;
+#endif
+}
 
-		// Get current path's byte length:
-		tickOpcode = GetNextContextBitfieldValue(2);
-		pContext.pathByteLen_Value = GetNextContextBitfieldValue((tickOpcode + 1) * BITS_PER_BYTE);
-		// Get current path's instruction bit address:
-		tickOpcode = GetNextContextBitfieldValue(2);
-		pContext.instrBitAddressBitfield_BitAddress = GetCurrentContextBitAddress();
-		pContext.instrBitAddressBitfield_BitWidth = (tickOpcode + 1) * BITS_PER_BYTE;
-		pContext.instrBitAddress_Value = GetNextContextBitfieldValue(pContext.instrBitAddressBitfield_BitWidth);
-		// Get current path's extra value:
-		tickOpcode = GetNextContextBitfieldValue(3);
-		pContext.extraValueBitfield_BitAddress = GetCurrentContextBitAddress();
-		pContext.extraValueBitfield_BitWidth = tickOpcode * BITS_PER_BYTE;
-		pContext.extraValue_Value = GetNextContextBitfieldValue(pContext.extraValueBitfield_BitWidth);    // returns zero if bit width is zero.
-		// Get current path's pause-ticks value:
-		tickOpcode = GetNextContextBitfieldValue(3);
-		pContext.pauseTicksBitfield_BitAddress = GetCurrentContextBitAddress();
-		pContext.pauseTicksBitfield_BitWidth = tickOpcode * BITS_PER_BYTE;
-		pContext.pauseTicks_Value = GetNextContextBitfieldValue(pContext.pauseTicksBitfield_BitWidth);    // returns zero if bit width is zero.
-
-		// Save current bit address in metadata region as start of next metadata-block:
-		gContext.nextContextBlock_BitAddress = GetCurrentContextBitAddress();
-
-		// Skip current instr path if ended or paused:
-		if (pContext.isEnded_Value) continue;
-
-		// Decrement pause-ticks if greater than zero
-		// and skip current path if still non-zero:
-		if (pContext.pauseTicks_Value)
-		{
-			pContext.pauseTicks_Value--;
-			SetContextBitfieldValue(pContext.pauseTicksBitfield_BitAddress, pContext.pauseTicksBitfield_BitWidth, pContext.pauseTicks_Value);
-			if (pContext.pauseTicks_Value) continue;
-		}
+int16_t FindNextActivePath(uint16_t startPathIdx)
+{
+	if (startPathIdx >= gContext.totalPaths_Value) return -1;
+
+	// Scan active-path bitmap a word at a time, masking off paths below start path:
+	uint8_t wordIdx = startPathIdx / PATHS_PER_WORD;
+	uint64_t u64Word = activePaths[wordIdx] & (~(uint64_t)0 << (startPathIdx % PATHS_PER_WORD));
+
+	while (!u64Word)
+	{
+		if (++wordIdx >= (gContext.totalPaths_Value + PATHS_PER_WORD - 1) / PATHS_PER_WORD) return -1;
+		u64Word = activePaths[wordIdx];
+	}
+
+	return wordIdx * PATHS_PER_WORD + CountTrailingZeros(u64Word);
+}
+
+bool IsAnimationEnded()
+{
+	return FindNextActivePath(0) < 0;
+}
 
-		// Process current path's instructions...
+#ifdef GLOW_ANIMATION_INSTANCES
+void SavePathIndex(struct PathIndex *ptrPathIndex)
+{
+	memcpy(ptrPathIndex->activePaths, activePaths, sizeof(activePaths));
+	memcpy(ptrPathIndex->pathBlocks, pathBlocks, gContext.totalPaths_Value * sizeof(struct PathBlockIndex));
+}
+
+void RestorePathIndex(const struct PathIndex *ptrPathIndex)
+{
+	memcpy(activePaths, ptrPathIndex->activePaths, sizeof(activePaths));
+	memcpy(pathBlocks, ptrPathIndex->pathBlocks, gContext.totalPaths_Value * sizeof(struct PathBlockIndex));
+}
+#endif
+
+bool LoadPathContext(uint8_t pathIdx, bool isSaveToRom)
+{
+	const struct PathBlockIndex *ptrBlock = &pathBlocks[pathIdx];
+	uint32_t fieldBitAddresses[NUM_PATH_FIELDS];
+	uint32_t bitAddress = ptrBlock->blockBitAddress;
+
+	// Locate each field of path's metadata-block from its offset index entry:
+	for (uint8_t fieldIdx = 0; fieldIdx < NUM_PATH_FIELDS; fieldIdx++)
+	{
+		bitAddress += fieldPrefixBitWidths[fieldIdx];
+		fieldBitAddresses[fieldIdx] = bitAddress;
+		bitAddress += GetFieldBitWidth(ptrBlock, fieldIdx);
+	}
+
+	// Get path's is-ended value:
+	pContext.pathIdx_Value = pathIdx;
+	pContext.isEnded_Value = GetContextBitfieldValue(pContext.isEndedBitfield_BitAddress + pathIdx, 1);
+
+	// Get path's start-byte address:
+	pContext.pathStartByteAddress_Value = GetContextBitfieldValue(fieldBitAddresses[PathStartByteAddressField], GetFieldBitWidth(ptrBlock, PathStartByteAddressField));
+
+	if (!isSaveToRom)
+	{
+		// Reinit instruction bit handler to start of each instruction path (since instr bit addr is relative to start of current instr path):
+		InitInstrBitHandler(ptrSramBufferStart + gContext.contextRegionByteLen_Value + pContext.pathStartByteAddress_Value);
+	}
+
+	// Get path's byte length:
+	pContext.pathByteLen_Value = GetContextBitfieldValue(fieldBitAddresses[PathByteLenField], GetFieldBitWidth(ptrBlock, PathByteLenField));
+	// Get path's instruction bit address:
+	pContext.instrBitAddressBitfield_BitAddress = fieldBitAddresses[InstrBitAddressField];
+	pContext.instrBitAddressBitfield_BitWidth = GetFieldBitWidth(ptrBlock, InstrBitAddressField);
+	pContext.instrBitAddress_Value = GetContextBitfieldValue(pContext.instrBitAddressBitfield_BitAddress, pContext.instrBitAddressBitfield_BitWidth);
+	// Get path's extra value:
+	pContext.extraValueBitfield_BitAddress = fieldBitAddresses[ExtraValueField];
+	pContext.extraValueBitfield_BitWidth = GetFieldBitWidth(ptrBlock, ExtraValueField);
+	pContext.extraValue_Value = 0;
+	if (pContext.extraValueBitfield_BitWidth) pContext.extraValue_Value = GetContextBitfieldValue(pContext.extraValueBitfield_BitAddress, pContext.extraValueBitfield_BitWidth);
+	// Get path's pause-ticks value:
+	pContext.pauseTicksBitfield_BitAddress = fieldBitAddresses[PauseTicksField];
+	pContext.pauseTicksBitfield_BitWidth = GetFieldBitWidth(ptrBlock, PauseTicksField);
+	pContext.pauseTicks_Value = 0;
+	if (pContext.pauseTicksBitfield_BitWidth) pContext.pauseTicks_Value = GetContextBitfieldValue(pContext.pauseTicksBitfield_BitAddress, pContext.pauseTicksBitfield_BitWidth);
+
+	// Skip path if ended or paused:
+	if (pContext.isEnded_Value) return false;
+
+	// Decrement pause-ticks if greater than zero
+	// and skip path if still non-zero:
+	if (pContext.pauseTicks_Value)
+	{
+		pContext.pauseTicks_Value--;
+		SetContextBitfieldValue(pContext.pauseTicksBitfield_BitAddress, pContext.pauseTicksBitfield_BitWidth, pContext.pauseTicks_Value);
+		if (pContext.pauseTicks_Value) return false;
+	}
+
+	return true;
+}
+
+void RunPathInstructions(bool isSaveToRom)
+{
+	// Process current path's instructions...
 #ifdef NVM_BUF_START_ADDR
-		if (isSaveToRom)
+	if (isSaveToRom)
+	{
+		// Context switch i.e. load current path's instructions into sram (immediately following metadata-region):
+		if (LoadPathInstructions(pContext.pathStartByteAddress_Value, pContext.pathByteLen_Value) == 0 && gContext.isInstrRegionPacked)
 		{
-			// Context switch i.e. load current path's instructions into sram (immediately following metadata-region):
-			gContext.ptrNvm = NVM_BUF_START_ADDR + gContext.contextRegionByteLen_Value + pContext.pathStartByteAddress_Value;  // flash start byte of current path.
-			gContext.ptrSram = ptrSramBufferStart + gContext.contextRegionByteLen_Value;
-			FlashRead(gContext.ptrNvm, gContext.ptrSram, pContext.pathByteLen_Value);
+			DecodeAssert(false);
+			return;	// skip malformed packed path rather than decode stale sram.
 		}
+	}
 #endif
 
-		// Switch bit handler to start of instruction region:
-		SetCurrentInstrBitAddress(pContext.instrBitAddress_Value);  // set bit handler to first bit of sram-loaded path instructions (byte->bit shifted).
+	// Switch bit handler to start of instruction region:
+	SetCurrentInstrBitAddress(pContext.instrBitAddress_Value);  // set bit handler to first bit of sram-loaded path instructions (byte->bit shifted).
+	TraceRecord(TracePathRun, pContext.pathIdx_Value, 0, pContext.instrBitAddress_Value, 0);
 
-		// Repeatedly process current path's instructions until path is complete or paused:
-		while (ProcessNextInstruction()) { continue; };
+	// Repeatedly process current path's instructions until path is complete or paused:
+	while (ProcessNextInstruction()) { continue; };
 
-		//printf("completed path=%d\n", pContext.pathIdx_Value);  // sim debugging.
+	TraceRecord(TracePathStop, pContext.pathIdx_Value, 0, GetCurrentInstrBitAddress(), 0);
 
-	} while (++pContext.pathIdx_Value < gContext.totalPaths_Value);
+	//printf("completed path=%d\n", pContext.pathIdx_Value);  // sim debugging.
+}
 
-	// Reset to first metadata region block:
+bool RunAnimation(bool isSaveToRom)
+{
+	TraceRecord(TraceTickStart, TRACE_NO_PATH, 0, gContext.tickCount, 0);
+
+#ifdef GLOW_PATH_WORKERS
+	if (!isSaveToRom && StartPathWorkers())
+	{
+		// Decode runnable paths in parallel when all paths are resident in sram:
+		RunPathsParallel();
+	}
+	else
+#endif
+	{
+		// Visit active paths only, rescanning from the next index since paths may activate later paths:
+		for (int16_t pathIdx = FindNextActivePath(0); pathIdx >= 0; pathIdx = FindNextActivePath(pathIdx + 1))
+		{
+			if (LoadPathContext(pathIdx, isSaveToRom)) RunPathInstructions(isSaveToRom);
+		}
+	}
+
+	// Reset to first path:
 	pContext.pathIdx_Value = 0;
-	gContext.nextContextBlock_BitAddress = gContext.firstContextBlock_BitAddress;
 
 	// Update ledstrip if ledstrip buffer is dirty:
-	if (ledstripBuffer.isDirty) ProgramLedstrip(&ledstripBuffer);
+	CommitLedstripBuffer();
+
+	TraceRecord(TraceTickEnd, TRACE_NO_PATH, 0, gContext.tickCount, 0);
+	gContext.tickCount++;
 
 	//printf("updated ledstrip...\n");  // sim debugging.
 
-    return true;
-}
\ No newline at end of file
+    return !IsAnimationEnded();
+}
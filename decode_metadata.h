@@ -15,30 +15,63 @@ enum Instr
 	Pc2Dev_Pause = 3,
 	Pc2Dev_GlowImmediate = 4,
 	Pc2Dev_GlowRamp = 5,
+	Pc2Dev_GlowImmediateSpans = 6,
+	Pc2Dev_GlowRampSpans = 7,
+	Pc2Dev_PackedContextRegion = 12,
 	Pc2Dev_ContextRegion = 13,
 	Pc2Dev_PathActivate = 14,
 	Pc2Dev_PathEnd = 15
 };
 
+#define MAX_PATHS 256
+#define PATHS_PER_WORD 64
+
+enum PathField
+{
+	PathStartByteAddressField = 0,
+	PathByteLenField = 1,
+	InstrBitAddressField = 2,
+	ExtraValueField = 3,
+	PauseTicksField = 4,
+	NUM_PATH_FIELDS = 5
+};
+
+#define FIELD_BYTE_LEN_BITS 3
+
+/**
+ * Offset index entry of a path's metadata-block, so that any path's fields are reached without walking the
+ * variable-width metadata-blocks before it. Field byte lengths (1-4 for the first three fields, 0-7 for extra value
+ * and pause-ticks) are packed 3 bits each, field 0 in the least significant bits.
+**/
+struct PathBlockIndex
+{
+	uint32_t blockBitAddress;
+	uint16_t fieldByteLens;
+};
+
 struct GlobalContext
 {
     uint32_t ptrNvm;
+    uint32_t nvmStartAddr;
+    bool isInstrRegionPacked;
     uint8_t *ptrSram;
-    enum Instr currInstr;
     uint8_t totalPaths_Value;
     uint32_t instrRegionByteLen_Value;
     uint16_t contextRegionByteLen_Value;
+    uint16_t contextSramByteLen;	// sram bytes holding metadata-region (its resident pages while paged), instructions follow.
     uint16_t totalLeds_Value;
     uint16_t tickIntervalMs_Value;
     uint16_t simBrightCoeff_Value;
     uint16_t firstContextBlock_BitAddress;
-    uint32_t nextContextBlock_BitAddress;
+    uint32_t randomSeed;
+    uint32_t tickCount;		// ticks run since animation context was loaded.
 };
 extern volatile struct GlobalContext gContext;
 
 struct PathContext
 {
     // Current path data:
+    enum Instr currInstr;
     uint8_t pathIdx_Value;
     uint32_t pathStartByteAddress_Value;
     uint32_t pathByteLen_Value;
@@ -54,6 +87,89 @@ struct PathContext
     uint32_t extraValueBitfield_BitAddress;
     uint8_t extraValueBitfield_BitWidth;
 };
-extern volatile struct PathContext pContext;
+extern GLOW_THREAD_LOCAL volatile struct PathContext pContext;
+
+/**
+ * Decode metadata-region common data into gContext from the start of the metadata-region bit handler's buffer,
+ * leaving the bit handler at the first metadata-block.
+ *
+ * param[in]: isSaveToRom: Specifies whether animation binary data is in ROM region or SRAM region.
+ *
+ * return: Whether the metadata-region opcode is valid.
+**/
+extern bool DecodeContextCommonData(bool isSaveToRom);
+
+/**
+ * Decode metadata-region common data of the animation at gContext.nvmStartAddr (ROM) or ptrSramBufferStart (SRAM)
+ * and reset the bit handlers. Ledstrip buffer is left untouched.
+ *
+ * param[in]: isSaveToRom: Specifies whether animation binary data is in ROM region or SRAM region.
+ * param[in]: isContextCached: Specifies whether the entire metadata-region is already in sram, and already verified
+ *            in GLOW_VERIFY_ANIMATION builds.
+ *
+ * return: Initialization status.
+**/
+extern bool LoadAnimationContext(bool isSaveToRom, bool isContextCached);
+
+/**
+ * Load a ROM path's instructions into sram immediately following the metadata-region, unpacking them if the
+ * animation's instruction region is packed.
+ *
+ * param[in]: pathStartByteAddress: path start byte address within instruction region.
+ * param[in]: pathByteLen: path byte length within instruction region.
+ *
+ * return: Byte length of path instructions in sram, zero if a packed path is malformed.
+**/
+extern uint32_t LoadPathInstructions(uint32_t pathStartByteAddress, uint32_t pathByteLen);
+
+/**
+ * Set path-ended bit of a path in metadata-region and in the active-path bitmap.
+**/
+extern void SetPathEnded(uint8_t pathIdx, bool isEnded);
+
+/**
+ * Find the lowest active (not ended) path index at or above startPathIdx.
+ *
+ * return: Path index, or -1 if no path from startPathIdx onwards is active.
+**/
+extern int16_t FindNextActivePath(uint16_t startPathIdx);
+
+/**
+ * Decode the metadata-block of a path into pContext and count down its pause ticks. The block is located through
+ * the offset index built when the animation context is loaded, so paths may be loaded in any order.
+ *
+ * param[in]: pathIdx: path index.
+ * param[in]: isSaveToRom: Specifies whether animation binary data is in ROM region or SRAM region.
+ *
+ * return: Whether the path is runnable this tick.
+**/
+extern bool LoadPathContext(uint8_t pathIdx, bool isSaveToRom);
+
+/**
+ * Run the instructions of the path in pContext until it is complete or paused.
+**/
+extern void RunPathInstructions(bool isSaveToRom);
+
+/**
+ * Check whether every path of the animation has ended.
+**/
+extern bool IsAnimationEnded();
+
+#ifdef GLOW_ANIMATION_INSTANCES
+/**
+ * Active-path bitmap and metadata-block offset index of an animation instance that is not running.
+**/
+struct PathIndex
+{
+	uint64_t activePaths[MAX_PATHS / PATHS_PER_WORD];
+	struct PathBlockIndex pathBlocks[MAX_PATHS];
+};
+
+/**
+ * Save or restore the active-path bitmap and offset index of the animation in gContext (paths in use only).
+**/
+extern void SavePathIndex(struct PathIndex *ptrPathIndex);
+extern void RestorePathIndex(const struct PathIndex *ptrPathIndex);
+#endif
 
 #endif /* DECODE_METADATA_H_ */
\ No newline at end of file
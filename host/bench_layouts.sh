@@ -0,0 +1,46 @@
+#!/bin/sh
+#
+#  Copyright 2018-2021 ledmaker.org
+#
+#  This file is part of Glow Decompiler Lib.
+#
+#  Compares decode time of interleaved and planar (GLOW_PLANAR_LEDS) ledstrip color data on generated animations,
+#  and checks both layouts push the same frames. Run from the repository root, eg.:
+#
+#  host/bench_layouts.sh [led count] [ticks] [extra cc flags...]
+#
+
+set -e
+
+LEDS=${1:-1200}
+TICKS=${2:-2000}
+[ $# -gt 0 ] && shift
+[ $# -gt 0 ] && shift
+
+OUT=$(mktemp -d)
+trap 'rm -rf "$OUT"' EXIT
+
+CFLAGS="-std=gnu11 -O2 -I. -Ihost -DGLOW_PROTOCOL_VERSION=2 -DLED_COUNT=$LEDS -DSRAM_BUF_SZ=65535 \
+    -DNVM_BUF_START_ADDR=0 -DNVM_BUF_END_ADDR=0x1000000"
+SOURCES="*.c host/glow_host.c host/sim_flash.c host/sim_ledstrip.c"
+
+cc -O2 -I. host/gen_animation.c -o "$OUT/gen_animation"
+cc $CFLAGS "$@" $SOURCES -o "$OUT/glow_interleaved" -lpthread
+cc $CFLAGS -DGLOW_PLANAR_LEDS "$@" $SOURCES -o "$OUT/glow_planar" -lpthread
+
+# Sparse and dense bitmap masks, and strided span masks:
+printf "%-24s %14s %14s  %s\n" "animation" "interleaved us" "planar us" "frames"
+for INPUT in "--density 5" "--density 50" "--density 95" "--spans"; do
+    "$OUT/gen_animation" --leds "$LEDS" --paths 32 $INPUT "$OUT/animation.bin" > /dev/null
+    "$OUT/glow_interleaved" --ticks "$TICKS" "$OUT/animation.bin" > "$OUT/interleaved.txt"
+    "$OUT/glow_planar" --ticks "$TICKS" "$OUT/animation.bin" > "$OUT/planar.txt"
+
+    INTERLEAVED_US=$(sed -n 's/.*per tick avg \([0-9.]*\) us.*/\1/p' "$OUT/interleaved.txt")
+    PLANAR_US=$(sed -n 's/.*per tick avg \([0-9.]*\) us.*/\1/p' "$OUT/planar.txt")
+    if [ "$(grep framehash "$OUT/interleaved.txt")" = "$(grep framehash "$OUT/planar.txt")" ]; then
+        FRAMES="equal"
+    else
+        FRAMES="DIFFER"
+    fi
+    printf "%-24s %14s %14s  %s\n" "$INPUT" "$INTERLEAVED_US" "$PLANAR_US" "$FRAMES"
+done
@@ -0,0 +1,329 @@
+/*
+ *  Copyright 2018-2021 ledmaker.org
+ *
+ *  This file is part of Glow Decompiler Lib.
+ *
+ *  Single-threaded Linux driver for many animation instances: one timerfd armed for the earliest tick deadline and
+ *  one eventfd for ledstrip push completions, both waited on with epoll.
+ *
+ */
+
+#include "public_api.h"
+#include <errno.h>
+#include <pthread.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+#include "event_loop.h"
+
+#define NS_PER_SEC 1000000000ull
+#define NS_PER_MS 1000000ull
+#define MAX_EPOLL_EVENTS 2
+
+struct LoopAnimation
+{
+    uint64_t deadlineNs;        // monotonic time of next tick.
+    uint64_t intervalNs;
+    uint64_t numTicks;
+    bool isAdded;
+    bool isEnded;               // every path of the animation has ended, no more ticks are scheduled.
+    bool isScheduled;           // instance is in the deadline heap.
+    bool isPushInFlight;
+    bool isTickBlocked;         // deadline passed while push was in flight, tick runs on push completion.
+};
+
+static struct LoopAnimation loopAnimations[GLOW_ANIMATION_INSTANCES];
+static uint16_t deadlineHeap[GLOW_ANIMATION_INSTANCES];     // min-heap of scheduled instances by deadline.
+static uint16_t heapSize;
+static uint16_t numPushesInFlight;
+
+static pthread_mutex_t completionMutex = PTHREAD_MUTEX_INITIALIZER;
+static uint16_t completedPushes[GLOW_ANIMATION_INSTANCES];  // at most one push per instance is in flight.
+static uint16_t numCompletedPushes;
+
+static int epollFd = -1;
+static int timerFd = -1;
+static int wakeFd = -1;
+static uint64_t armedDeadlineNs;
+static bool isStopRequested;
+static struct EventLoopStats loopStats;
+
+static uint64_t GetLoopNs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * NS_PER_SEC + ts.tv_nsec;
+}
+
+static bool IsEarlier(uint16_t instanceIdxA, uint16_t instanceIdxB)
+{
+    // Order by deadline, then by instance index so that equal deadlines run in a fixed order:
+    if (loopAnimations[instanceIdxA].deadlineNs != loopAnimations[instanceIdxB].deadlineNs)
+    {
+        return loopAnimations[instanceIdxA].deadlineNs < loopAnimations[instanceIdxB].deadlineNs;
+    }
+    return instanceIdxA < instanceIdxB;
+}
+
+static void PushDeadline(uint16_t instanceIdx)
+{
+    // Sift new entry up from the end of the heap:
+    uint16_t heapIdx = heapSize++;
+    loopAnimations[instanceIdx].isScheduled = true;
+    while (heapIdx > 0 && IsEarlier(instanceIdx, deadlineHeap[(heapIdx - 1) / 2]))
+    {
+        deadlineHeap[heapIdx] = deadlineHeap[(heapIdx - 1) / 2];
+        heapIdx = (heapIdx - 1) / 2;
+    }
+    deadlineHeap[heapIdx] = instanceIdx;
+}
+
+static uint16_t PopDeadline()
+{
+    uint16_t earliestIdx = deadlineHeap[0];
+    uint16_t lastIdx = deadlineHeap[--heapSize];
+    uint16_t heapIdx = 0;
+
+    // Sift last entry down from the root:
+    while (true)
+    {
+        uint16_t childIdx = 2 * heapIdx + 1;
+        if (childIdx >= heapSize) break;
+        if (childIdx + 1 < heapSize && IsEarlier(deadlineHeap[childIdx + 1], deadlineHeap[childIdx])) childIdx++;
+        if (!IsEarlier(deadlineHeap[childIdx], lastIdx)) break;
+        deadlineHeap[heapIdx] = deadlineHeap[childIdx];
+        heapIdx = childIdx;
+    }
+    deadlineHeap[heapIdx] = lastIdx;
+    loopAnimations[earliestIdx].isScheduled = false;
+
+    return earliestIdx;
+}
+
+static void WakeLoop()
+{
+    uint64_t u64Count = 1;
+
+    // A failing write means the eventfd counter is saturated, so the loop is being woken anyway:
+    while (write(wakeFd, &u64Count, sizeof(u64Count)) < 0 && errno == EINTR) { continue; }
+}
+
+static void CloseLoopFds()
+{
+    if (epollFd >= 0) close(epollFd);
+    if (timerFd >= 0) close(timerFd);
+    if (wakeFd >= 0) close(wakeFd);
+    epollFd = timerFd = wakeFd = -1;
+}
+
+static bool ArmTimer(uint64_t deadlineNs)
+{
+    if (deadlineNs == armedDeadlineNs) return true;    // timer already armed (or disarmed) for this deadline.
+
+    // Zero deadline disarms the timer:
+    struct itimerspec timerSpec = { .it_interval = { 0, 0 },
+        .it_value = { .tv_sec = deadlineNs / NS_PER_SEC, .tv_nsec = deadlineNs % NS_PER_SEC } };
+    if (timerfd_settime(timerFd, TFD_TIMER_ABSTIME, &timerSpec, NULL) != 0) return false;
+    armedDeadlineNs = deadlineNs;
+
+    return true;
+}
+
+static void HandleCompletedPushes()
+{
+    uint16_t instanceIdxs[GLOW_ANIMATION_INSTANCES];
+
+    pthread_mutex_lock(&completionMutex);
+    uint16_t numPushes = numCompletedPushes;
+    memcpy(instanceIdxs, completedPushes, numPushes * sizeof(uint16_t));
+    numCompletedPushes = 0;
+    pthread_mutex_unlock(&completionMutex);
+
+    // Reschedule ticks that were blocked by the completed pushes, they are due already:
+    for (uint16_t pushIdx = 0; pushIdx < numPushes; pushIdx++)
+    {
+        struct LoopAnimation *ptrAnimation = &loopAnimations[instanceIdxs[pushIdx]];
+        if (!ptrAnimation->isPushInFlight) continue;
+
+        ptrAnimation->isPushInFlight = false;
+        numPushesInFlight--;
+        if (ptrAnimation->isTickBlocked)
+        {
+            ptrAnimation->isTickBlocked = false;
+            PushDeadline(instanceIdxs[pushIdx]);
+        }
+    }
+}
+
+static void RunLoopTick(uint16_t instanceIdx, uint64_t nowNs)
+{
+    struct LoopAnimation *ptrAnimation = &loopAnimations[instanceIdx];
+
+    uint64_t latenessNs = nowNs - ptrAnimation->deadlineNs;
+    if (latenessNs > loopStats.maxLatenessNs) loopStats.maxLatenessNs = latenessNs;
+    if (latenessNs > ptrAnimation->intervalNs) loopStats.numLateTicks++;
+
+    ptrAnimation->isEnded = !RunAnimationInstance(instanceIdx);
+
+    // Advance deadline from the previous one, so that a late instance catches up:
+    ptrAnimation->deadlineNs += ptrAnimation->intervalNs;
+    ptrAnimation->numTicks++;
+    loopStats.numTicks++;
+}
+
+bool InitEventLoop()
+{
+    CloseLoopFds();
+    memset(loopAnimations, 0, sizeof(loopAnimations));
+    memset(&loopStats, 0, sizeof(loopStats));
+    heapSize = 0;
+    numPushesInFlight = 0;
+    numCompletedPushes = 0;
+    armedDeadlineNs = 0;
+
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (epollFd < 0 || timerFd < 0 || wakeFd < 0)
+    {
+        CloseLoopFds();
+        return false;
+    }
+
+    struct epoll_event timerEvent = { .events = EPOLLIN, .data.fd = timerFd };
+    struct epoll_event wakeEvent = { .events = EPOLLIN, .data.fd = wakeFd };
+    if (epoll_ctl(epollFd, EPOLL_CTL_ADD, timerFd, &timerEvent) != 0 || epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &wakeEvent) != 0)
+    {
+        CloseLoopFds();
+        return false;
+    }
+
+    return true;
+}
+
+bool AddLoopAnimation(uint16_t instanceIdx, uint8_t *ptrSramBuffer, uint32_t nvmStartAddr, bool isSaveToRom)
+{
+    if (instanceIdx >= GLOW_ANIMATION_INSTANCES || loopAnimations[instanceIdx].isAdded) return false;
+
+    // Initialization pushes a frame, which may be deferred:
+    if (!InitAnimationInstance(instanceIdx, ptrSramBuffer, nvmStartAddr, isSaveToRom)) return false;
+
+    struct LoopAnimation *ptrAnimation = &loopAnimations[instanceIdx];
+    uint16_t tickIntervalMs = GetAnimationInstanceTickInterval(instanceIdx);
+    ptrAnimation->intervalNs = (tickIntervalMs ? tickIntervalMs : 1) * NS_PER_MS;   // keep zero intervals from starving other instances.
+    ptrAnimation->deadlineNs = GetLoopNs() + ptrAnimation->intervalNs;
+    ptrAnimation->isAdded = true;
+    PushDeadline(instanceIdx);
+
+    return true;
+}
+
+bool RunEventLoop(uint64_t numTicks)
+{
+    struct epoll_event events[MAX_EPOLL_EVENTS];
+    uint16_t numRunning = 0;
+
+    __atomic_store_n(&isStopRequested, false, __ATOMIC_RELAXED);
+
+    // Rebuild the heap with deadlines rebased to now, so ticks missed while the loop was stopped are not caught up.
+    // Animations with ticks left are scheduled, including those that reached the tick count of a previous run:
+    uint64_t startNs = GetLoopNs();
+    heapSize = 0;
+    for (uint16_t instanceIdx = 0; instanceIdx < GLOW_ANIMATION_INSTANCES; instanceIdx++)
+    {
+        struct LoopAnimation *ptrAnimation = &loopAnimations[instanceIdx];
+        ptrAnimation->isScheduled = false;
+        ptrAnimation->isTickBlocked = false;
+        if (!ptrAnimation->isAdded || ptrAnimation->isEnded || (numTicks && ptrAnimation->numTicks >= numTicks)) continue;
+
+        numRunning++;
+        ptrAnimation->deadlineNs = startNs + ptrAnimation->intervalNs;
+        PushDeadline(instanceIdx);
+    }
+
+    while (!__atomic_load_n(&isStopRequested, __ATOMIC_RELAXED) && (numRunning || numPushesInFlight))
+    {
+        uint64_t wakeNs = GetLoopNs(), decodeNs = 0, nowNs = wakeNs;
+        HandleCompletedPushes();
+
+        // Run due ticks in deadline order:
+        while (heapSize && loopAnimations[deadlineHeap[0]].deadlineNs <= nowNs)
+        {
+            uint16_t instanceIdx = PopDeadline();
+            struct LoopAnimation *ptrAnimation = &loopAnimations[instanceIdx];
+            if (ptrAnimation->isPushInFlight)
+            {
+                ptrAnimation->isTickBlocked = true;
+                loopStats.numBlockedTicks++;
+                continue;
+            }
+
+            RunLoopTick(instanceIdx, nowNs);
+            uint64_t tickEndNs = GetLoopNs();
+            decodeNs += tickEndNs - nowNs;
+            nowNs = tickEndNs;
+
+            // Drop instances whose animation has ended or that ran all their ticks:
+            if (!ptrAnimation->isEnded && (numTicks == 0 || ptrAnimation->numTicks < numTicks)) PushDeadline(instanceIdx);
+            else numRunning--;
+        }
+
+        // Sleep until the earliest deadline or a push completion:
+        if (!ArmTimer(heapSize ? loopAnimations[deadlineHeap[0]].deadlineNs : 0)) return false;
+        loopStats.decodeNs += decodeNs;
+        loopStats.loopNs += GetLoopNs() - wakeNs - decodeNs;
+        if (!numRunning && !numPushesInFlight) break;
+
+        int numEvents = epoll_wait(epollFd, events, MAX_EPOLL_EVENTS, -1);
+        if (numEvents < 0)
+        {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        loopStats.numWakeups++;
+
+        for (int eventIdx = 0; eventIdx < numEvents; eventIdx++)
+        {
+            // Clear timer expirations and wake counter, both fds are non-blocking:
+            uint64_t u64Count;
+            if (read(events[eventIdx].data.fd, &u64Count, sizeof(u64Count)) < 0 && errno != EAGAIN) return false;
+            if (events[eventIdx].data.fd == timerFd) armedDeadlineNs = 0;
+        }
+    }
+
+    return true;
+}
+
+void StopEventLoop()
+{
+    __atomic_store_n(&isStopRequested, true, __ATOMIC_RELAXED);
+    WakeLoop();
+}
+
+bool DeferLedstripPush()
+{
+    uint16_t instanceIdx = GetActiveAnimationInstance();
+
+    if (instanceIdx >= GLOW_ANIMATION_INSTANCES || loopAnimations[instanceIdx].isPushInFlight) return false;
+    loopAnimations[instanceIdx].isPushInFlight = true;
+    numPushesInFlight++;
+
+    return true;
+}
+
+void CompleteLedstripPush(uint16_t instanceIdx)
+{
+    pthread_mutex_lock(&completionMutex);
+    if (numCompletedPushes < GLOW_ANIMATION_INSTANCES) completedPushes[numCompletedPushes++] = instanceIdx;
+    pthread_mutex_unlock(&completionMutex);
+
+    WakeLoop();
+}
+
+struct EventLoopStats GetEventLoopStats()
+{
+    return loopStats;
+}
@@ -0,0 +1,76 @@
+/*
+ *  Copyright 2018-2021 ledmaker.org
+ *
+ *  This file is part of Glow Decompiler Lib.
+ *
+ */
+
+#ifndef EVENT_LOOP_H_
+#define EVENT_LOOP_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * Counters of the event loop. Decode time is spent in RunAnimationInstance, loop time is the rest of the time
+ * the loop thread is awake (deadline bookkeeping, timer and completion handling).
+**/
+struct EventLoopStats
+{
+    uint64_t numTicks;
+    uint64_t numWakeups;
+    uint64_t numLateTicks;      // ticks run more than one tick interval after their deadline.
+    uint64_t numBlockedTicks;   // ticks that fell due while the instance's previous ledstrip push was in flight.
+    uint64_t maxLatenessNs;
+    uint64_t decodeNs;
+    uint64_t loopNs;
+};
+
+/**
+ * Create the loop's timerfd, completion eventfd and epoll instance, dropping any registered animations.
+ *
+ * return: Initialization status.
+**/
+extern bool InitEventLoop();
+
+/**
+ * Initialize an animation instance (see InitAnimationInstance) and schedule its first tick one tick interval from now.
+ *
+ * return: Initialization status.
+**/
+extern bool AddLoopAnimation(uint16_t instanceIdx, uint8_t *ptrSramBuffer, uint32_t nvmStartAddr, bool isSaveToRom);
+
+/**
+ * Run due ticks of all added animations in deadline order on the calling thread, sleeping in epoll_wait on a single
+ * timerfd armed for the earliest deadline. A tick that falls due while the instance's ledstrip push is in flight
+ * runs once the push completes, and later deadlines are kept so the instance catches up. Each call schedules the
+ * first tick of every animation one tick interval from entry, so ticks missed while the loop was stopped are
+ * skipped rather than run in a burst. Animations whose paths have all ended are dropped from the loop.
+ *
+ * param[in]: numTicks: ticks to run per animation, zero to run until StopEventLoop or every animation has ended.
+ *
+ * return: Whether the loop ran without a system call failing.
+**/
+extern bool RunEventLoop(uint64_t numTicks);
+
+/**
+ * Make RunEventLoop return after its current wakeup. May be called from any thread.
+**/
+extern void StopEventLoop();
+
+/**
+ * Mark the push of the running instance as in flight. Call from ProgramLedstrip when it hands the frame to
+ * hardware that completes later. The instance's leds stay untouched until CompleteLedstripPush is called.
+ *
+ * return: Whether the push is deferred, false if no instance is running or its previous push is still in flight.
+**/
+extern bool DeferLedstripPush();
+
+/**
+ * Report that an instance's deferred ledstrip push has completed. May be called from any thread.
+**/
+extern void CompleteLedstripPush(uint16_t instanceIdx);
+
+extern struct EventLoopStats GetEventLoopStats();
+
+#endif /* EVENT_LOOP_H_ */
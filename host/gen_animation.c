@@ -0,0 +1,416 @@
+/*
+ *  Copyright 2018-2021 ledmaker.org
+ *
+ *  This file is part of Glow Decompiler Lib.
+ *
+ *  Generator of synthetic animation images for the host harness, so glow_host runs without an animation exported
+ *  from the editor. Every path loops forever over glow immediate, glow ramp and pause instructions on pseudo-random
+ *  led masks, the same image for the same options. Build from the repository root, eg.:
+ *
+ *  cc -O2 -I. host/gen_animation.c -o gen_animation
+ *  ./gen_animation --leds 300 --paths 16 animation.bin && ./glow_host animation.bin
+ *
+ *  The number of leds must match the LED_COUNT of the glow_host build.
+ *
+ */
+
+#include "public_api.h"
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bit_handler.h"
+#include "decode_metadata.h"
+
+#define DEFAULT_LEDS 300
+#define DEFAULT_PATHS 16
+#define DEFAULT_INSTRS 8
+#define TICK_INTERVAL_MS 20
+#define SIM_BRIGHT_COEFF 500
+#define IMAGE_BUF_SZ (1 << 24)
+#define MAX_SPANS 8
+
+#define RED_MASK 0x08
+#define GREEN_MASK 0x04
+#define BLUE_MASK 0x02
+#define BRIGHT_MASK 0x01
+
+#define REPEAT_RUN_FLAG 0x80
+#define REPEAT_RUN_MIN_LEN 2
+#define MAX_RUN_LEN 128
+
+struct BitWriter
+{
+    uint8_t *ptrBuffer;
+    uint32_t bufferSz;
+    uint32_t bitLen;
+};
+
+struct GenConfig
+{
+    uint16_t numLeds;
+    uint16_t numPaths;
+    uint16_t numInstrs;
+    uint8_t maskDensityPct;
+    bool isSpanMask;
+    bool isPacked;
+    bool isMixedWidths;
+};
+
+static uint8_t instrRegion[IMAGE_BUF_SZ];
+static uint8_t packedRegion[IMAGE_BUF_SZ];
+static uint8_t contextRegion[UINT16_MAX];
+static uint32_t pathByteAddresses[MAX_PATHS];
+static uint32_t pathByteLens[MAX_PATHS];
+static uint32_t pathInstrBitLens[MAX_PATHS];     // unpacked, bounds the instruction bit address field.
+static uint8_t pathFieldByteLens[MAX_PATHS][NUM_PATH_FIELDS];
+static uint32_t randomState;
+
+static uint32_t NextRandom()
+{
+    // xorshift32, never zero for a non-zero state:
+    randomState ^= randomState << 13;
+    randomState ^= randomState >> 17;
+    randomState ^= randomState << 5;
+    return randomState;
+}
+
+static uint32_t NextRandomBelow(uint32_t bound)
+{
+    return NextRandom() % bound;
+}
+
+static bool PutBits(struct BitWriter *ptrWriter, uint32_t value, uint8_t bitfieldWidth)
+{
+    if (ptrWriter->bitLen + bitfieldWidth > (uint64_t)ptrWriter->bufferSz * 8) return false;
+
+    // Most significant bit first, as the decoder's bit handler reads it:
+    for (uint8_t bitIdx = bitfieldWidth; bitIdx-- > 0;)
+    {
+        uint32_t byteIdx = ptrWriter->bitLen >> 3;
+        uint8_t bitMask = 0x80 >> (ptrWriter->bitLen & 7);
+        if ((value >> bitIdx) & 1) ptrWriter->ptrBuffer[byteIdx] |= bitMask;
+        else ptrWriter->ptrBuffer[byteIdx] &= ~bitMask;
+        ptrWriter->bitLen++;
+    }
+
+    return true;
+}
+
+static uint8_t GetValueByteLen(uint32_t value)
+{
+    uint8_t byteLen = 1;
+    while (byteLen < 4 && (value >> (byteLen * 8))) byteLen++;
+    return byteLen;
+}
+
+static bool PutTicks(struct BitWriter *ptrWriter, uint32_t ticks)
+{
+    // Tick opcode holds the value byte length minus one:
+    uint8_t byteLen = GetValueByteLen(ticks);
+    return PutBits(ptrWriter, byteLen - 1, 2) && PutBits(ptrWriter, ticks, byteLen * 8);
+}
+
+static bool PutLedMask(struct BitWriter *ptrWriter, const struct GenConfig *ptrConfig)
+{
+    bool isPut = true;
+
+    if (ptrConfig->isSpanMask)
+    {
+        // Strided spans of pseudo-random length, each repeat within the ledstrip:
+        uint8_t numSpans = 1 + NextRandomBelow(MAX_SPANS);
+        isPut = PutBits(ptrWriter, 1, 2) && PutBits(ptrWriter, numSpans, 8);
+        for (uint8_t spanIdx = 0; spanIdx < numSpans && isPut; spanIdx++)
+        {
+            uint16_t numLeds = 1 + NextRandomBelow(ptrConfig->numLeds);
+            uint16_t ledStride = numLeds + NextRandomBelow(ptrConfig->numLeds);
+            uint16_t numRepeats = 1 + (ptrConfig->numLeds - numLeds) / ledStride;
+            uint16_t startLedIdx = NextRandomBelow(ptrConfig->numLeds - ((numRepeats - 1) * ledStride + numLeds) + 1);
+            isPut = PutBits(ptrWriter, startLedIdx, 16) && PutBits(ptrWriter, numLeds, 16)
+                && PutBits(ptrWriter, ledStride, 16) && PutBits(ptrWriter, numRepeats, 16);
+        }
+        return isPut;
+    }
+
+    // One bit per led, set at the mask density:
+    for (uint16_t ledIdx = 0; ledIdx < ptrConfig->numLeds && isPut; ledIdx++)
+    {
+        isPut = PutBits(ptrWriter, NextRandomBelow(100) < ptrConfig->maskDensityPct, 1);
+    }
+    return isPut;
+}
+
+static bool PutGlowImmediate(struct BitWriter *ptrWriter, const struct GenConfig *ptrConfig)
+{
+    uint8_t colorBitmap = 1 + NextRandomBelow(15);
+    bool isRandom = NextRandomBelow(4) == 0;
+    bool isPut = PutBits(ptrWriter, ptrConfig->isSpanMask ? Pc2Dev_GlowImmediateSpans : Pc2Dev_GlowImmediate, 4)
+        && PutBits(ptrWriter, colorBitmap, 4) && PutBits(ptrWriter, isRandom ? 3 : 0, 2);
+
+    // Absolute values follow unless drawn per led, brightness is 5 bits:
+    if (!isRandom)
+    {
+        if (colorBitmap & RED_MASK) isPut = isPut && PutBits(ptrWriter, NextRandomBelow(256), 8);
+        if (colorBitmap & GREEN_MASK) isPut = isPut && PutBits(ptrWriter, NextRandomBelow(256), 8);
+        if (colorBitmap & BLUE_MASK) isPut = isPut && PutBits(ptrWriter, NextRandomBelow(256), 8);
+        if (colorBitmap & BRIGHT_MASK) isPut = isPut && PutBits(ptrWriter, NextRandomBelow(32), 5);
+    }
+
+    return isPut && PutLedMask(ptrWriter, ptrConfig);
+}
+
+static bool PutGlowRamp(struct BitWriter *ptrWriter, const struct GenConfig *ptrConfig)
+{
+    uint8_t colorBitmap = 1 + NextRandomBelow(15);
+    bool isPut = PutBits(ptrWriter, ptrConfig->isSpanMask ? Pc2Dev_GlowRampSpans : Pc2Dev_GlowRamp, 4)
+        && PutTicks(ptrWriter, 1 + NextRandomBelow(40)) && PutBits(ptrWriter, colorBitmap, 4);
+
+    // Each ramped channel: start value, then increment or decrement by a step every few ticks:
+    for (uint8_t channelMask = RED_MASK; channelMask && isPut; channelMask >>= 1)
+    {
+        if (!(colorBitmap & channelMask)) continue;
+
+        uint8_t incDecOp = 1 + NextRandomBelow(2);
+        isPut = PutBits(ptrWriter, NextRandomBelow(256), 8) && PutBits(ptrWriter, incDecOp, 2)
+            && PutTicks(ptrWriter, 1 + NextRandomBelow(3)) && PutBits(ptrWriter, 1 + NextRandomBelow(16), 8);
+    }
+
+    return isPut && PutLedMask(ptrWriter, ptrConfig);
+}
+
+static bool PutPath(struct BitWriter *ptrWriter, const struct GenConfig *ptrConfig)
+{
+    bool isPut = true;
+
+    for (uint16_t instrIdx = 0; instrIdx < ptrConfig->numInstrs && isPut; instrIdx++)
+    {
+        uint32_t instrKind = NextRandomBelow(10);
+        if (instrKind < 4) isPut = PutGlowImmediate(ptrWriter, ptrConfig);
+        else if (instrKind < 7) isPut = PutGlowRamp(ptrWriter, ptrConfig);
+        else isPut = PutBits(ptrWriter, Pc2Dev_Pause, 4) && PutTicks(ptrWriter, 1 + NextRandomBelow(10));
+    }
+
+    // Pause at least once per loop so the path yields, then go back to the path start (bit address zero):
+    return isPut && PutBits(ptrWriter, Pc2Dev_Pause, 4) && PutTicks(ptrWriter, 1)
+        && PutBits(ptrWriter, Pc2Dev_Goto, 4) && PutBits(ptrWriter, 0, 32);
+}
+
+static uint32_t PutLiteralRun(uint8_t *ptrPacked, const uint8_t *ptrLiteral, uint32_t literalLen)
+{
+    if (!literalLen) return 0;
+
+    ptrPacked[0] = literalLen - 1;
+    memcpy(ptrPacked + 1, ptrLiteral, literalLen);
+    return literalLen + 1;
+}
+
+static uint32_t PackRegion(const uint8_t *ptrRegion, uint32_t byteLen, uint8_t *ptrPacked)
+{
+    uint32_t packedLen = 0, literalStart = 0, byteIdx = 0;
+
+    // Literal and repeat runs as described in unpack_instruction.h:
+    while (byteIdx < byteLen)
+    {
+        uint32_t runLen = 1;
+        while (byteIdx + runLen < byteLen && ptrRegion[byteIdx + runLen] == ptrRegion[byteIdx]
+            && runLen < MAX_RUN_LEN + REPEAT_RUN_MIN_LEN - 1) runLen++;
+
+        if (runLen >= REPEAT_RUN_MIN_LEN)
+        {
+            packedLen += PutLiteralRun(ptrPacked + packedLen, ptrRegion + literalStart, byteIdx - literalStart);
+            ptrPacked[packedLen++] = REPEAT_RUN_FLAG | (runLen - REPEAT_RUN_MIN_LEN);
+            ptrPacked[packedLen++] = ptrRegion[byteIdx];
+            byteIdx += runLen;
+            literalStart = byteIdx;
+            continue;
+        }
+
+        byteIdx++;
+        if (byteIdx - literalStart == MAX_RUN_LEN)
+        {
+            packedLen += PutLiteralRun(ptrPacked + packedLen, ptrRegion + literalStart, MAX_RUN_LEN);
+            literalStart = byteIdx;
+        }
+    }
+
+    return packedLen + PutLiteralRun(ptrPacked + packedLen, ptrRegion + literalStart, byteIdx - literalStart);
+}
+
+static bool PutContextRegion(struct BitWriter *ptrWriter, const struct GenConfig *ptrConfig, uint16_t contextByteLen,
+    uint32_t instrByteLen)
+{
+    bool isPut = PutBits(ptrWriter, ptrConfig->isPacked ? Pc2Dev_PackedContextRegion : Pc2Dev_ContextRegion, 4)
+        && PutBits(ptrWriter, contextByteLen, 16) && PutBits(ptrWriter, instrByteLen, 32)
+        && PutBits(ptrWriter, ptrConfig->numLeds, 16) && PutBits(ptrWriter, TICK_INTERVAL_MS, 16)
+        && PutBits(ptrWriter, SIM_BRIGHT_COEFF, 16) && PutBits(ptrWriter, ptrConfig->numPaths, 8);
+
+    // Every path starts active:
+    for (uint16_t pathIdx = 0; pathIdx < ptrConfig->numPaths && isPut; pathIdx++)
+    {
+        isPut = PutBits(ptrWriter, 0, 1);
+    }
+
+    // Metadata-block per path: start byte address, byte length, instruction bit address, extra value, pause ticks,
+    // each field's byte length (minus one for the first three fields) preceding it:
+    for (uint16_t pathIdx = 0; pathIdx < ptrConfig->numPaths && isPut; pathIdx++)
+    {
+        const uint8_t *ptrByteLens = pathFieldByteLens[pathIdx];
+        isPut = PutBits(ptrWriter, ptrByteLens[PathStartByteAddressField] - 1, 2)
+            && PutBits(ptrWriter, pathByteAddresses[pathIdx], ptrByteLens[PathStartByteAddressField] * 8)
+            && PutBits(ptrWriter, ptrByteLens[PathByteLenField] - 1, 2)
+            && PutBits(ptrWriter, pathByteLens[pathIdx], ptrByteLens[PathByteLenField] * 8)
+            && PutBits(ptrWriter, ptrByteLens[InstrBitAddressField] - 1, 2)
+            && PutBits(ptrWriter, 0, ptrByteLens[InstrBitAddressField] * 8)
+            && PutBits(ptrWriter, ptrByteLens[ExtraValueField], 3) && PutBits(ptrWriter, 0, ptrByteLens[ExtraValueField] * 8)
+            && PutBits(ptrWriter, ptrByteLens[PauseTicksField], 3) && PutBits(ptrWriter, 0, ptrByteLens[PauseTicksField] * 8);
+    }
+
+    return isPut;
+}
+
+static uint8_t GetFieldByteLen(const struct GenConfig *ptrConfig, uint8_t minByteLen, uint8_t defaultByteLen)
+{
+    // Values are read as 32 bits, so fields are at most 4 bytes:
+    if (ptrConfig->isMixedWidths) return minByteLen + NextRandomBelow(4 - minByteLen + 1);
+    return (defaultByteLen > minByteLen) ? defaultByteLen : minByteLen;
+}
+
+static void SetFieldByteLens(const struct GenConfig *ptrConfig)
+{
+    // Extra value holds at most a ramp tick count, and pause-ticks a pause, each fitting one byte:
+    for (uint16_t pathIdx = 0; pathIdx < ptrConfig->numPaths; pathIdx++)
+    {
+        uint8_t *ptrByteLens = pathFieldByteLens[pathIdx];
+        ptrByteLens[PathStartByteAddressField] = GetFieldByteLen(ptrConfig, GetValueByteLen(pathByteAddresses[pathIdx]), 1);
+        ptrByteLens[PathByteLenField] = GetFieldByteLen(ptrConfig, GetValueByteLen(pathByteLens[pathIdx]), 1);
+        ptrByteLens[InstrBitAddressField] = GetFieldByteLen(ptrConfig, GetValueByteLen(pathInstrBitLens[pathIdx]), 4);
+        ptrByteLens[ExtraValueField] = GetFieldByteLen(ptrConfig, 1, 2);
+        ptrByteLens[PauseTicksField] = GetFieldByteLen(ptrConfig, 1, 2);
+    }
+}
+
+static void PrintUsage(const char *ptrProgName)
+{
+    fprintf(stderr,
+        "usage: %s [options] animation.bin\n"
+        "  --leds N               ledstrip length, must match LED_COUNT of the player (default %d)\n"
+        "  --paths N              number of paths, at most %d (default %d)\n"
+        "  --instrs N             glow and pause instructions per path loop (default %d)\n"
+        "  --density N            percentage of leds set in each bitmap mask (default 50)\n"
+        "  --spans                use strided span masks instead of bitmap masks\n"
+        "  --packed               pack the instruction region (played in ROM mode only)\n"
+        "  --mixed-widths         vary metadata-block field widths (1-4 bytes) from path to path\n"
+        "  --seed N               pseudo-random generator seed (default 1)\n",
+        ptrProgName, DEFAULT_LEDS, MAX_PATHS - 1, DEFAULT_PATHS, DEFAULT_INSTRS);
+}
+
+int main(int argc, char **argv)
+{
+    static const struct option options[] =
+    {
+        { "leds", required_argument, NULL, 'l' },
+        { "paths", required_argument, NULL, 'p' },
+        { "instrs", required_argument, NULL, 'i' },
+        { "density", required_argument, NULL, 'd' },
+        { "spans", no_argument, NULL, 'S' },
+        { "packed", no_argument, NULL, 'P' },
+        { "mixed-widths", no_argument, NULL, 'W' },
+        { "seed", required_argument, NULL, 's' },
+        { NULL, 0, NULL, 0 }
+    };
+    struct GenConfig config = { .numLeds = DEFAULT_LEDS, .numPaths = DEFAULT_PATHS, .numInstrs = DEFAULT_INSTRS,
+        .maskDensityPct = 50, .isSpanMask = false, .isPacked = false,
+        .isMixedWidths = false };
+    uint32_t seed = 1;
+    int option;
+
+    while ((option = getopt_long(argc, argv, "", options, NULL)) != -1)
+    {
+        switch (option)
+        {
+            case 'l': config.numLeds = (uint16_t)strtoul(optarg, NULL, 0); break;
+            case 'p': config.numPaths = (uint16_t)strtoul(optarg, NULL, 0); break;
+            case 'i': config.numInstrs = (uint16_t)strtoul(optarg, NULL, 0); break;
+            case 'd': config.maskDensityPct = (uint8_t)strtoul(optarg, NULL, 0); break;
+            case 'S': config.isSpanMask = true; break;
+            case 'P': config.isPacked = true; break;
+            case 'W': config.isMixedWidths = true; break;
+            case 's': seed = (uint32_t)strtoul(optarg, NULL, 0); break;
+            default: PrintUsage(argv[0]); return EXIT_FAILURE;
+        }
+    }
+    if (optind != argc - 1 || !config.numLeds || !config.numPaths || config.numPaths >= MAX_PATHS)
+    {
+        PrintUsage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    randomState = seed ? seed : 1;
+
+    // Instruction region, each path starting on a byte boundary:
+    struct BitWriter instrWriter = { .ptrBuffer = instrRegion, .bufferSz = sizeof(instrRegion), .bitLen = 0 };
+    for (uint16_t pathIdx = 0; pathIdx < config.numPaths; pathIdx++)
+    {
+        struct BitWriter pathWriter = { .ptrBuffer = instrRegion + instrWriter.bitLen / 8,
+            .bufferSz = sizeof(instrRegion) - instrWriter.bitLen / 8, .bitLen = 0 };
+        if (!PutPath(&pathWriter, &config))
+        {
+            fprintf(stderr, "gen_animation: instruction region exceeds %d bytes\n", IMAGE_BUF_SZ);
+            return EXIT_FAILURE;
+        }
+        pathByteAddresses[pathIdx] = instrWriter.bitLen / 8;
+        pathByteLens[pathIdx] = (pathWriter.bitLen + 7) / 8;
+        pathInstrBitLens[pathIdx] = pathWriter.bitLen;
+        instrWriter.bitLen += pathByteLens[pathIdx] * 8;
+    }
+    const uint8_t *ptrInstrRegion = instrRegion;
+    uint32_t instrByteLen = instrWriter.bitLen / 8;
+
+    // Packed paths are packed one by one, so each path's byte address and length refer to the packed region:
+    if (config.isPacked)
+    {
+        uint32_t packedLen = 0;
+        for (uint16_t pathIdx = 0; pathIdx < config.numPaths; pathIdx++)
+        {
+            uint32_t pathPackedLen = PackRegion(instrRegion + pathByteAddresses[pathIdx], pathByteLens[pathIdx],
+                packedRegion + packedLen);
+            pathByteAddresses[pathIdx] = packedLen;
+            pathByteLens[pathIdx] = pathPackedLen;
+            packedLen += pathPackedLen;
+        }
+        ptrInstrRegion = packedRegion;
+        instrByteLen = packedLen;
+    }
+
+    SetFieldByteLens(&config);
+
+    // Metadata-region length is part of its own common data, so size it with a first pass:
+    struct BitWriter contextWriter = { .ptrBuffer = contextRegion, .bufferSz = sizeof(contextRegion), .bitLen = 0 };
+    if (!PutContextRegion(&contextWriter, &config, 0, instrByteLen))
+    {
+        fprintf(stderr, "gen_animation: metadata-region exceeds %d bytes\n", UINT16_MAX);
+        return EXIT_FAILURE;
+    }
+    uint16_t contextByteLen = (contextWriter.bitLen + 7) / 8;
+    memset(contextRegion, 0, sizeof(contextRegion));
+    contextWriter.bitLen = 0;
+    PutContextRegion(&contextWriter, &config, contextByteLen, instrByteLen);
+
+    FILE *imageFile = fopen(argv[optind], "wb");
+    if (!imageFile)
+    {
+        fprintf(stderr, "gen_animation: cannot write %s\n", argv[optind]);
+        return EXIT_FAILURE;
+    }
+    bool isWritten = fwrite(contextRegion, 1, contextByteLen, imageFile) == contextByteLen
+        && fwrite(ptrInstrRegion, 1, instrByteLen, imageFile) == instrByteLen;
+    if (fclose(imageFile) != 0 || !isWritten)
+    {
+        fprintf(stderr, "gen_animation: cannot write %s\n", argv[optind]);
+        return EXIT_FAILURE;
+    }
+
+    printf("%s: %u leds, %u paths, metadata-region %u bytes, instruction region %u bytes%s\n", argv[optind],
+        config.numLeds, config.numPaths, contextByteLen, instrByteLen, config.isPacked ? " (packed)" : "");
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,374 @@
+/*
+ *  Copyright 2018-2021 ledmaker.org
+ *
+ *  This file is part of Glow Decompiler Lib.
+ *
+ *  Linux host harness that plays an animation against a simulated flash part and ledstrip, and reports decode
+ *  time, flash traffic and ledstrip traffic. Build from the repository root, eg.:
+ *
+ *  cc -O2 -I. -Ihost -DGLOW_PROTOCOL_VERSION=2 -DLED_COUNT=300 -DSRAM_BUF_SZ=65535 -DNVM_BUF_START_ADDR=0 \
+ *     -DNVM_BUF_END_ADDR=0x1000000 *.c host/glow_host.c host/sim_flash.c host/sim_ledstrip.c -o glow_host -lpthread
+ *
+ *  host/gen_animation.c writes an animation image to play, eg. gen_animation --leds 300 animation.bin.
+ *
+ *  Add -DGLOW_TRACE_EVENTS=65536 to record an execution trace, written by --trace and read by glow_trace
+ *  (see host/trace_analyzer.c).
+ *
+ *  Add -DGLOW_ANIMATION_INSTANCES=64 and host/event_loop.c to play --instances copies of the animation from a single
+ *  timerfd/epoll event loop, at the animation's tick interval.
+ *
+ *  Add -DGLOW_RENDER_AHEAD_FRAMES=8 to play with --render-ahead, decoding on a producer thread while the main thread
+ *  pushes a frame every tick interval.
+ *
+ */
+
+#include "public_api.h"
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "sim_flash.h"
+#include "sim_ledstrip.h"
+#include "trace_dump.h"
+#ifdef GLOW_ANIMATION_INSTANCES
+#include "event_loop.h"
+#endif
+
+#define NS_PER_US 1000ull
+#define NS_PER_MS 1000000ull
+#define NS_PER_SEC 1000000000ull
+#define DEFAULT_TICKS 1000
+
+static uint8_t sramBuffer[SRAM_BUF_SZ];
+uint8_t *ptrSramBufferStart = sramBuffer;
+
+#ifdef GLOW_ANIMATION_INSTANCES
+static uint8_t instanceSramBuffers[GLOW_ANIMATION_INSTANCES][SRAM_BUF_SZ];
+#endif
+
+struct TickStats
+{
+    uint64_t numTicks;
+    uint64_t totalNs;
+    uint64_t minNs;
+    uint64_t maxNs;
+};
+
+#ifdef GLOW_TRACE_EVENTS
+uint32_t GetTraceTimestamp()
+{
+    return (uint32_t)GetMonotonicNs();
+}
+
+static bool WriteTraceDump(const char *dumpPath)
+{
+    static struct TraceEvent traceEvents[GLOW_TRACE_EVENTS];
+    struct TraceDumpHeader header = { .magic = TRACE_DUMP_MAGIC, .version = TRACE_DUMP_VERSION,
+        .eventSz = sizeof(struct TraceEvent), .numEvents = 0, .totalEvents = GetTraceEventCount() };
+
+    FILE *dumpFile = fopen(dumpPath, "wb");
+    if (!dumpFile) return false;
+
+    header.numEvents = ReadTraceEvents(traceEvents, GLOW_TRACE_EVENTS);
+    bool isWritten = fwrite(&header, sizeof(header), 1, dumpFile) == 1
+        && fwrite(traceEvents, sizeof(struct TraceEvent), header.numEvents, dumpFile) == header.numEvents;
+
+    return fclose(dumpFile) == 0 && isWritten;
+}
+#endif
+
+static void PrintUsage(const char *ptrProgName)
+{
+    fprintf(stderr,
+        "usage: %s [options] animation.bin\n"
+        "  --rom                  play from simulated flash (ROM mode), default plays from SRAM\n"
+        "  --ticks N              animation ticks to run (default %d)\n"
+        "  --seed N               random value seed\n"
+        "  --flash-latency-us N   latency per flash page touched by a read\n"
+        "  --flash-bandwidth N    flash bytes per second (0: unlimited)\n"
+        "  --flash-page-size N    flash page byte size (default 256)\n"
+        "  --strip-bandwidth N    ledstrip bytes per second (0: unlimited)\n"
+        "  --strip-bytes-per-led N  ledstrip bytes per led (default 4)\n"
+        "  --realtime             spin for modeled flash and ledstrip time\n"
+        "  --trace FILE           write execution trace dump (GLOW_TRACE_EVENTS builds)\n"
+        "  --instances N          play N instances from an event loop (GLOW_ANIMATION_INSTANCES builds)\n"
+        "  --async-push           complete event loop ledstrip pushes from a sink thread after the modeled time\n"
+        "  --render-ahead         decode on a producer thread, push at the tick interval (GLOW_RENDER_AHEAD_FRAMES builds)\n",
+        ptrProgName, DEFAULT_TICKS);
+}
+
+static void PrintSinkReport()
+{
+    struct SimFlashStats flashStats = GetSimFlashStats();
+    struct SimLedstripStats ledstripStats = GetSimLedstripStats();
+
+    printf("flash:     %llu reads, %llu bytes, %llu pages, modeled %.3f ms\n", (unsigned long long)flashStats.numReads,
+        (unsigned long long)flashStats.numBytes, (unsigned long long)flashStats.numPages, flashStats.modeledNs / 1e6);
+#ifdef GLOW_CONTEXT_PAGES
+    printf("swap:      %llu page writes, %llu page reads, %llu bytes\n", (unsigned long long)flashStats.numSwapWrites,
+        (unsigned long long)flashStats.numSwapReads, (unsigned long long)flashStats.numSwapBytes);
+#endif
+    printf("ledstrip:  %llu frames, %llu bytes, modeled %.3f ms, sink %.3f ms (included in decode)\n",
+        (unsigned long long)ledstripStats.numFrames, (unsigned long long)ledstripStats.numBytes,
+        ledstripStats.modeledNs / 1e6, ledstripStats.sinkNs / 1e6);
+    printf("framehash: %016llx\n", (unsigned long long)ledstripStats.frameHash);
+}
+
+static void PrintReport(bool isSaveToRom, struct TickStats tickStats)
+{
+    struct SimLedstripStats ledstripStats = GetSimLedstripStats();
+
+    printf("mode:      %s\n", isSaveToRom ? "rom" : "sram");
+    printf("ticks:     %llu (interval %u ms, brightness coeff %u)\n", (unsigned long long)tickStats.numTicks,
+        ledstripStats.tickIntervalMs, ledstripStats.brightnessCoeff);
+    printf("decode:    total %.3f ms, per tick avg %.1f us, min %.1f us, max %.1f us\n",
+        tickStats.totalNs / 1e6, tickStats.numTicks ? tickStats.totalNs / 1e3 / tickStats.numTicks : 0.0,
+        tickStats.minNs / 1e3, tickStats.maxNs / 1e3);
+    printf("           total %.3f ms excluding ledstrip sink\n", (tickStats.totalNs - ledstripStats.sinkNs) / 1e6);
+    PrintSinkReport();
+}
+
+#ifdef GLOW_ANIMATION_INSTANCES
+static void PrintLoopReport(bool isSaveToRom, uint16_t numInstances)
+{
+    struct EventLoopStats loopStats = GetEventLoopStats();
+    struct SimLedstripStats ledstripStats = GetSimLedstripStats();
+
+    printf("mode:      %s, %u instances\n", isSaveToRom ? "rom" : "sram", numInstances);
+    printf("ticks:     %llu (interval %u ms, brightness coeff %u)\n", (unsigned long long)loopStats.numTicks,
+        ledstripStats.tickIntervalMs, ledstripStats.brightnessCoeff);
+    printf("loop:      %llu wakeups, %.1f ticks per wakeup, %llu late, %llu blocked on push, max lateness %.3f ms\n",
+        (unsigned long long)loopStats.numWakeups,
+        loopStats.numWakeups ? (double)loopStats.numTicks / loopStats.numWakeups : 0.0,
+        (unsigned long long)loopStats.numLateTicks, (unsigned long long)loopStats.numBlockedTicks,
+        loopStats.maxLatenessNs / 1e6);
+    printf("decode:    total %.3f ms, per tick avg %.1f us, loop overhead %.3f ms\n", loopStats.decodeNs / 1e6,
+        loopStats.numTicks ? loopStats.decodeNs / 1e3 / loopStats.numTicks : 0.0, loopStats.loopNs / 1e6);
+    PrintSinkReport();
+
+    // Instances play the same animation from the same seed, so each must push the same frames as instance 0:
+    bool isHashEqual = true;
+    for (uint16_t instanceIdx = 1; instanceIdx < numInstances; instanceIdx++)
+    {
+        if (GetSimLedstripInstanceHash(instanceIdx) != GetSimLedstripInstanceHash(0)) isHashEqual = false;
+    }
+    printf("instances: hash %016llx, %s\n", (unsigned long long)GetSimLedstripInstanceHash(0),
+        isHashEqual ? "equal across instances" : "DIFFERS across instances");
+}
+#endif
+
+#ifdef GLOW_ANIMATION_INSTANCES
+static bool RunInstances(bool isSaveToRom, uint16_t numInstances, uint64_t numTicks)
+{
+    if (!InitEventLoop()) return false;
+
+    // Each instance decodes from its own sram buffer, holding a copy of the animation in SRAM mode:
+    for (uint16_t instanceIdx = 0; instanceIdx < numInstances; instanceIdx++)
+    {
+        if (!isSaveToRom) memcpy(instanceSramBuffers[instanceIdx], sramBuffer, SRAM_BUF_SZ);
+        if (!AddLoopAnimation(instanceIdx, instanceSramBuffers[instanceIdx], NVM_BUF_START_ADDR, isSaveToRom)) return false;
+    }
+
+    if (!RunEventLoop(numTicks)) return false;
+
+    PrintLoopReport(isSaveToRom, numInstances);
+
+    return true;
+}
+#endif
+
+#ifdef GLOW_RENDER_AHEAD_FRAMES
+static void SleepUntilNs(uint64_t deadlineNs)
+{
+    struct timespec ts = { .tv_sec = deadlineNs / NS_PER_SEC, .tv_nsec = deadlineNs % NS_PER_SEC };
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) != 0) { continue; }
+}
+
+static bool RunRenderAhead(bool isSaveToRom, uint64_t numTicks)
+{
+    if (!StartRenderAhead(isSaveToRom)) return false;
+
+    // Push one frame per tick interval on an absolute schedule, as a tick timer interrupt would:
+    uint16_t tickIntervalMs = GetSimLedstripStats().tickIntervalMs;
+    uint64_t intervalNs = (tickIntervalMs ? tickIntervalMs : 1) * NS_PER_MS;
+    uint64_t deadlineNs = GetMonotonicNs();
+    uint64_t numReadyTicks = 0;
+    uint64_t occupancySum = 0;
+    uint8_t maxOccupancy = 0;
+    for (uint64_t tickIdx = 0; tickIdx < numTicks; tickIdx++)
+    {
+        deadlineNs += intervalNs;
+        SleepUntilNs(deadlineNs);
+
+        uint8_t occupancy = GetRenderAheadOccupancy();
+        occupancySum += occupancy;
+        if (occupancy > maxOccupancy) maxOccupancy = occupancy;
+        if (PushRenderAheadFrame()) numReadyTicks++;
+    }
+    uint32_t numUnderruns = GetRenderAheadUnderruns();
+    StopRenderAhead();
+
+    struct SimLedstripStats ledstripStats = GetSimLedstripStats();
+    printf("mode:      %s, render-ahead %d frames\n", isSaveToRom ? "rom" : "sram", GLOW_RENDER_AHEAD_FRAMES);
+    printf("ticks:     %llu (interval %u ms, brightness coeff %u)\n", (unsigned long long)numTicks,
+        ledstripStats.tickIntervalMs, ledstripStats.brightnessCoeff);
+    printf("ring:      %llu ticks with a frame ready, %u underruns, occupancy avg %.1f, max %u\n",
+        (unsigned long long)numReadyTicks, numUnderruns, numTicks ? (double)occupancySum / numTicks : 0.0,
+        maxOccupancy);
+    PrintSinkReport();
+
+    return true;
+}
+#endif
+
+int main(int argc, char **argv)
+{
+    static const struct option options[] =
+    {
+        { "rom", no_argument, NULL, 'r' },
+        { "ticks", required_argument, NULL, 't' },
+        { "seed", required_argument, NULL, 's' },
+        { "flash-latency-us", required_argument, NULL, 'l' },
+        { "flash-bandwidth", required_argument, NULL, 'b' },
+        { "flash-page-size", required_argument, NULL, 'p' },
+        { "strip-bandwidth", required_argument, NULL, 'B' },
+        { "strip-bytes-per-led", required_argument, NULL, 'L' },
+        { "realtime", no_argument, NULL, 'R' },
+        { "trace", required_argument, NULL, 'T' },
+        { "instances", required_argument, NULL, 'I' },
+        { "async-push", no_argument, NULL, 'A' },
+        { "render-ahead", no_argument, NULL, 'F' },
+        { NULL, 0, NULL, 0 }
+    };
+    struct SimFlashConfig flashConfig = { .latencyNs = 0, .bytesPerSec = 0, .pageSz = 256, .isRealtime = false };
+    struct SimLedstripConfig ledstripConfig = { .bytesPerLed = 4, .frameStartBytes = 4, .frameEndBytes = 4,
+        .bytesPerSec = 0, .isRealtime = false, .isAsync = false };
+    bool isSaveToRom = false;
+    uint64_t numTicks = DEFAULT_TICKS;
+    uint32_t seed = 0;
+    const char *tracePath = NULL;
+    uint32_t numInstances = 0;
+    bool isRenderAhead = false;
+    int option;
+
+    while ((option = getopt_long(argc, argv, "", options, NULL)) != -1)
+    {
+        switch (option)
+        {
+            case 'r': isSaveToRom = true; break;
+            case 't': numTicks = strtoull(optarg, NULL, 0); break;
+            case 's': seed = (uint32_t)strtoul(optarg, NULL, 0); break;
+            case 'l': flashConfig.latencyNs = (uint32_t)(strtoul(optarg, NULL, 0) * NS_PER_US); break;
+            case 'b': flashConfig.bytesPerSec = (uint32_t)strtoul(optarg, NULL, 0); break;
+            case 'p': flashConfig.pageSz = (uint32_t)strtoul(optarg, NULL, 0); break;
+            case 'B': ledstripConfig.bytesPerSec = (uint32_t)strtoul(optarg, NULL, 0); break;
+            case 'L': ledstripConfig.bytesPerLed = (uint32_t)strtoul(optarg, NULL, 0); break;
+            case 'R': flashConfig.isRealtime = ledstripConfig.isRealtime = true; break;
+            case 'T': tracePath = optarg; break;
+            case 'I': numInstances = (uint32_t)strtoul(optarg, NULL, 0); break;
+            case 'A': ledstripConfig.isAsync = true; break;
+            case 'F': isRenderAhead = true; break;
+            default: PrintUsage(argv[0]); return EXIT_FAILURE;
+        }
+    }
+    if (optind != argc - 1)
+    {
+        PrintUsage(argv[0]);
+        return EXIT_FAILURE;
+    }
+#ifdef GLOW_ANIMATION_INSTANCES
+    if (numInstances > GLOW_ANIMATION_INSTANCES)
+    {
+        fprintf(stderr, "glow_host: at most %d instances\n", GLOW_ANIMATION_INSTANCES);
+        return EXIT_FAILURE;
+    }
+#else
+    if (numInstances || ledstripConfig.isAsync)
+    {
+        fprintf(stderr, "glow_host: built without GLOW_ANIMATION_INSTANCES, no event loop\n");
+        return EXIT_FAILURE;
+    }
+#endif
+#ifndef GLOW_RENDER_AHEAD_FRAMES
+    if (isRenderAhead)
+    {
+        fprintf(stderr, "glow_host: built without GLOW_RENDER_AHEAD_FRAMES, no render-ahead\n");
+        return EXIT_FAILURE;
+    }
+#endif
+
+    // Animation image is the flash region contents, copied into sram for SRAM mode:
+    if (!LoadSimFlash(argv[optind], flashConfig))
+    {
+        fprintf(stderr, "glow_host: cannot load flash image %s\n", argv[optind]);
+        return EXIT_FAILURE;
+    }
+    if (!isSaveToRom && !CopySimFlashImage(sramBuffer, sizeof(sramBuffer)))
+    {
+        fprintf(stderr, "glow_host: animation does not fit in %d bytes of sram\n", SRAM_BUF_SZ);
+        return EXIT_FAILURE;
+    }
+    InitSimLedstrip(ledstripConfig);
+
+    SetRandomSeed(seed);
+#ifdef GLOW_ANIMATION_INSTANCES
+    if (numInstances)
+    {
+        if (!RunInstances(isSaveToRom, (uint16_t)numInstances, numTicks))
+        {
+            fprintf(stderr, "glow_host: event loop failed\n");
+            return EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
+    }
+#endif
+    if (!InitAnimation(isSaveToRom))
+    {
+        fprintf(stderr, "glow_host: animation initialization failed\n");
+        return EXIT_FAILURE;
+    }
+#ifdef GLOW_RENDER_AHEAD_FRAMES
+    if (isRenderAhead)
+    {
+        if (!RunRenderAhead(isSaveToRom, numTicks))
+        {
+            fprintf(stderr, "glow_host: render-ahead failed to start\n");
+            return EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
+    }
+#endif
+
+    // Time each tick back to back, the modeled flash and ledstrip time is included only in realtime mode:
+    struct TickStats tickStats = { .numTicks = 0, .totalNs = 0, .minNs = UINT64_MAX, .maxNs = 0 };
+    for (uint64_t tickIdx = 0; tickIdx < numTicks; tickIdx++)
+    {
+        uint64_t startNs = GetMonotonicNs();
+        RunAnimation(isSaveToRom);
+        uint64_t tickNs = GetMonotonicNs() - startNs;
+
+        tickStats.numTicks++;
+        tickStats.totalNs += tickNs;
+        if (tickNs < tickStats.minNs) tickStats.minNs = tickNs;
+        if (tickNs > tickStats.maxNs) tickStats.maxNs = tickNs;
+    }
+    if (!tickStats.numTicks) tickStats.minNs = 0;
+
+    PrintReport(isSaveToRom, tickStats);
+
+    if (tracePath)
+    {
+#ifdef GLOW_TRACE_EVENTS
+        if (!WriteTraceDump(tracePath))
+        {
+            fprintf(stderr, "glow_host: cannot write trace dump %s\n", tracePath);
+            return EXIT_FAILURE;
+        }
+#else
+        fprintf(stderr, "glow_host: built without GLOW_TRACE_EVENTS, no trace written\n");
+#endif
+    }
+
+    return EXIT_SUCCESS;
+}
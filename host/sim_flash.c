@@ -0,0 +1,138 @@
+/*
+ *  Copyright 2018-2021 ledmaker.org
+ *
+ *  This file is part of Glow Decompiler Lib.
+ *
+ */
+
+#include "public_api.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "sim_flash.h"
+
+#define ERASED_BYTE 0xFF
+#define NS_PER_SEC 1000000000ull
+
+static uint8_t *flashImage;
+static uint32_t flashImageSz;
+static struct SimFlashConfig flashConfig;
+static struct SimFlashStats flashStats;
+#ifdef GLOW_CONTEXT_PAGES
+static uint8_t swapStore[UINT16_MAX];   // external RAM holding evicted metadata-region pages.
+#endif
+
+uint64_t GetMonotonicNs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * NS_PER_SEC + ts.tv_nsec;
+}
+
+void SpinNs(uint64_t durationNs)
+{
+    uint64_t endNs = GetMonotonicNs() + durationNs;
+    while (GetMonotonicNs() < endNs) { continue; }
+}
+
+bool LoadSimFlash(const char *imagePath, struct SimFlashConfig config)
+{
+    FILE *imageFile = fopen(imagePath, "rb");
+    if (!imageFile) return false;
+
+    fseek(imageFile, 0, SEEK_END);
+    long imageSz = ftell(imageFile);
+    fseek(imageFile, 0, SEEK_SET);
+    if (imageSz <= 0 || (uint64_t)imageSz > (uint64_t)NVM_BUF_END_ADDR - NVM_BUF_START_ADDR)
+    {
+        fclose(imageFile);
+        return false; // abort if image is empty or does not fit in flash region.
+    }
+
+    free(flashImage);
+    flashImage = malloc(imageSz);
+    flashImageSz = (uint32_t)imageSz;
+    bool isRead = flashImage && fread(flashImage, 1, flashImageSz, imageFile) == flashImageSz;
+    fclose(imageFile);
+    if (!isRead) return false;
+
+    if (config.pageSz == 0) config.pageSz = 1;
+    flashConfig = config;
+    ResetSimFlashStats();
+
+    return true;
+}
+
+uint32_t CopySimFlashImage(uint8_t *ptrBuffer, uint32_t bufferSz)
+{
+    if (flashImageSz > bufferSz) return 0;
+
+    memcpy(ptrBuffer, flashImage, flashImageSz);
+
+    return flashImageSz;
+}
+
+struct SimFlashStats GetSimFlashStats()
+{
+    return flashStats;
+}
+
+void ResetSimFlashStats()
+{
+    memset(&flashStats, 0, sizeof(flashStats));
+}
+
+void FlashRead(uint32_t srcAddr, uint8_t *ptrBuffer, uint32_t length)
+{
+#if NVM_BUF_START_ADDR > 0
+    Assert(srcAddr >= NVM_BUF_START_ADDR);
+#endif
+    Assert((uint64_t)srcAddr + length <= NVM_BUF_END_ADDR);
+
+    // Copy image bytes, reading erased flash past the end of the image:
+    uint32_t imageOffset = srcAddr - NVM_BUF_START_ADDR;
+    uint32_t numImageBytes = 0;
+    if (imageOffset < flashImageSz)
+    {
+        numImageBytes = (flashImageSz - imageOffset < length) ? flashImageSz - imageOffset : length;
+        memcpy(ptrBuffer, flashImage + imageOffset, numImageBytes);
+    }
+    memset(ptrBuffer + numImageBytes, ERASED_BYTE, length - numImageBytes);
+
+    // Charge latency for every page the transaction touches, plus transfer time:
+    uint64_t numPages = 0;
+    if (length)
+    {
+        numPages = ((uint64_t)srcAddr + length - 1) / flashConfig.pageSz - srcAddr / flashConfig.pageSz + 1;
+    }
+    uint64_t costNs = numPages * flashConfig.latencyNs;
+    if (flashConfig.bytesPerSec) costNs += (uint64_t)length * NS_PER_SEC / flashConfig.bytesPerSec;
+
+    flashStats.numReads++;
+    flashStats.numBytes += length;
+    flashStats.numPages += numPages;
+    flashStats.modeledNs += costNs;
+
+    if (flashConfig.isRealtime) SpinNs(costNs);
+}
+
+#ifdef GLOW_CONTEXT_PAGES
+void SwapWrite(uint32_t swapAddr, uint8_t *ptrBuffer, uint32_t length)
+{
+    Assert((uint64_t)swapAddr + length <= sizeof(swapStore));
+
+    memcpy(swapStore + swapAddr, ptrBuffer, length);
+    flashStats.numSwapWrites++;
+    flashStats.numSwapBytes += length;
+}
+
+void SwapRead(uint32_t swapAddr, uint8_t *ptrBuffer, uint32_t length)
+{
+    Assert((uint64_t)swapAddr + length <= sizeof(swapStore));
+
+    memcpy(ptrBuffer, swapStore + swapAddr, length);
+    flashStats.numSwapReads++;
+    flashStats.numSwapBytes += length;
+}
+#endif
@@ -0,0 +1,67 @@
+/*
+ *  Copyright 2018-2021 ledmaker.org
+ *
+ *  This file is part of Glow Decompiler Lib.
+ *
+ */
+
+#ifndef SIM_FLASH_H_
+#define SIM_FLASH_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * Cost model of a simulated flash part. Each FlashRead is one transaction costing latency per page touched,
+ * plus transfer time at the given bandwidth (zero bandwidth transfers instantly).
+**/
+struct SimFlashConfig
+{
+    uint32_t latencyNs;         // per page touched by a transaction.
+    uint32_t bytesPerSec;       // transfer bandwidth.
+    uint32_t pageSz;            // byte size of a flash page.
+    bool isRealtime;            // whether to also spin for the modeled time, so wall-clock profiles include it.
+};
+
+/**
+ * Access counters of the simulated flash.
+**/
+struct SimFlashStats
+{
+    uint64_t numReads;
+    uint64_t numBytes;
+    uint64_t numPages;
+    uint64_t modeledNs;
+    uint64_t numSwapWrites;     // metadata-region pages written back (GLOW_CONTEXT_PAGES builds).
+    uint64_t numSwapReads;
+    uint64_t numSwapBytes;
+};
+
+/**
+ * Load a flash image file as the contents of the flash region starting at NVM_BUF_START_ADDR.
+ * Flash beyond the image reads as erased (0xFF).
+ *
+ * param[in]: imagePath: path of flash image file.
+ * param[in]: config: flash cost model.
+ *
+ * return: Load status.
+**/
+extern bool LoadSimFlash(const char *imagePath, struct SimFlashConfig config);
+
+/**
+ * Copy the loaded flash image into a buffer (for SRAM mode playback).
+ *
+ * return: Number of bytes copied, zero if the image does not fit.
+**/
+extern uint32_t CopySimFlashImage(uint8_t *ptrBuffer, uint32_t bufferSz);
+
+extern struct SimFlashStats GetSimFlashStats();
+extern void ResetSimFlashStats();
+
+/**
+ * Read monotonic clock, and spin for a modeled duration.
+**/
+extern uint64_t GetMonotonicNs();
+extern void SpinNs(uint64_t durationNs);
+
+#endif /* SIM_FLASH_H_ */
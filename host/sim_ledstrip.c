@@ -0,0 +1,180 @@
+/*
+ *  Copyright 2018-2021 ledmaker.org
+ *
+ *  This file is part of Glow Decompiler Lib.
+ *
+ */
+
+#include "public_api.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sim_flash.h"
+#include "sim_ledstrip.h"
+
+#ifdef GLOW_ANIMATION_INSTANCES
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+#include "event_loop.h"
+#endif
+
+#define NS_PER_SEC 1000000000ull
+#define FNV_OFFSET_BASIS 0xCBF29CE484222325ull
+#define FNV_PRIME 0x100000001B3ull
+
+static struct SimLedstripConfig ledstripConfig;
+static struct SimLedstripStats ledstripStats;
+
+#ifdef GLOW_ANIMATION_INSTANCES
+struct PendingPush
+{
+    uint16_t instanceIdx;
+    uint64_t doneNs;            // monotonic time the modeled transfer ends.
+};
+
+static uint64_t instanceHashes[GLOW_ANIMATION_INSTANCES];
+static struct PendingPush pendingPushes[GLOW_ANIMATION_INSTANCES];     // fifo, at most one push per instance is deferred.
+static uint16_t pendingPushHead;
+static uint16_t numPendingPushes;
+static pthread_mutex_t sinkMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t sinkCond = PTHREAD_COND_INITIALIZER;
+static bool isSinkStarted = false;
+#endif
+
+static uint64_t HashByte(uint64_t hash, uint8_t u8Val)
+{
+    return (hash ^ u8Val) * FNV_PRIME;
+}
+
+static uint64_t HashFrame(uint64_t hash, struct LedstripBuffer *ledstripBuffer)
+{
+    // Hash frame color data in led order:
+    for (uint16_t ledIdx = 0; ledIdx < ledstripBuffer->numLeds; ledIdx++)
+    {
+        hash = HashByte(hash, ledstripBuffer->leds[ledIdx].red);
+        hash = HashByte(hash, ledstripBuffer->leds[ledIdx].green);
+        hash = HashByte(hash, ledstripBuffer->leds[ledIdx].blue);
+        hash = HashByte(hash, ledstripBuffer->leds[ledIdx].bright);
+    }
+
+    return hash;
+}
+
+#ifdef GLOW_ANIMATION_INSTANCES
+static void *RunPushSink(void *ptrArg)
+{
+    (void)ptrArg;
+
+    while (true)
+    {
+        pthread_mutex_lock(&sinkMutex);
+        while (!numPendingPushes) pthread_cond_wait(&sinkCond, &sinkMutex);
+        struct PendingPush push = pendingPushes[pendingPushHead];
+        pendingPushHead = (pendingPushHead + 1) % GLOW_ANIMATION_INSTANCES;
+        numPendingPushes--;
+        pthread_mutex_unlock(&sinkMutex);
+
+        // Complete push once its modeled transfer has ended, pushes are queued in end time order:
+        struct timespec doneTs = { .tv_sec = push.doneNs / NS_PER_SEC, .tv_nsec = push.doneNs % NS_PER_SEC };
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &doneTs, NULL) == EINTR) { continue; }
+        CompleteLedstripPush(push.instanceIdx);
+    }
+
+    return NULL;
+}
+
+static bool QueuePendingPush(uint64_t costNs)
+{
+    if (!isSinkStarted)
+    {
+        pthread_t sinkThread;
+        if (pthread_create(&sinkThread, NULL, RunPushSink, NULL) != 0) return false;
+        pthread_detach(sinkThread);
+        isSinkStarted = true;
+    }
+
+    if (!DeferLedstripPush()) return false;
+
+    pthread_mutex_lock(&sinkMutex);
+    pendingPushes[(pendingPushHead + numPendingPushes) % GLOW_ANIMATION_INSTANCES] =
+        (struct PendingPush) { .instanceIdx = GetActiveAnimationInstance(), .doneNs = GetMonotonicNs() + costNs };
+    numPendingPushes++;
+    pthread_cond_signal(&sinkCond);
+    pthread_mutex_unlock(&sinkMutex);
+
+    return true;
+}
+
+uint64_t GetSimLedstripInstanceHash(uint16_t instanceIdx)
+{
+    return instanceHashes[instanceIdx];
+}
+#endif
+
+void InitSimLedstrip(struct SimLedstripConfig config)
+{
+    ledstripConfig = config;
+    memset(&ledstripStats, 0, sizeof(ledstripStats));
+    ledstripStats.frameHash = FNV_OFFSET_BASIS;
+#ifdef GLOW_ANIMATION_INSTANCES
+    for (uint16_t instanceIdx = 0; instanceIdx < GLOW_ANIMATION_INSTANCES; instanceIdx++)
+    {
+        instanceHashes[instanceIdx] = FNV_OFFSET_BASIS;
+    }
+#endif
+}
+
+struct SimLedstripStats GetSimLedstripStats()
+{
+    return ledstripStats;
+}
+
+void ProgramLedstrip(struct LedstripBuffer *ledstripBuffer)
+{
+    uint64_t startNs = GetMonotonicNs();
+
+    ledstripStats.frameHash = HashFrame(ledstripStats.frameHash, ledstripBuffer);
+#ifdef GLOW_ANIMATION_INSTANCES
+    uint16_t instanceIdx = GetActiveAnimationInstance();
+    if (instanceIdx < GLOW_ANIMATION_INSTANCES) instanceHashes[instanceIdx] = HashFrame(instanceHashes[instanceIdx], ledstripBuffer);
+#endif
+
+    // Count frame bytes on the wire and charge transfer time:
+    uint64_t numBytes = ledstripConfig.frameStartBytes + (uint64_t)ledstripBuffer->numLeds * ledstripConfig.bytesPerLed
+        + ledstripConfig.frameEndBytes;
+    uint64_t costNs = ledstripConfig.bytesPerSec ? numBytes * NS_PER_SEC / ledstripConfig.bytesPerSec : 0;
+
+    ledstripStats.numFrames++;
+    ledstripStats.numBytes += numBytes;
+    ledstripStats.modeledNs += costNs;
+
+#ifdef GLOW_ANIMATION_INSTANCES
+    // Hand frame to the sink thread, which completes the push after the modeled time instead of blocking the loop:
+    bool isDeferred = ledstripConfig.isAsync && QueuePendingPush(costNs);
+    if (ledstripConfig.isRealtime && !isDeferred) SpinNs(costNs);
+#else
+    if (ledstripConfig.isRealtime) SpinNs(costNs);
+#endif
+
+    ledstripBuffer->isDirty = false;
+    ledstripStats.sinkNs += GetMonotonicNs() - startNs;
+}
+
+void SetTickInterval(uint16_t tickIntervalMs)
+{
+    ledstripStats.tickIntervalMs = tickIntervalMs;
+}
+
+void SaveBrightnessCoefficient(uint16_t brightnessCoeff)
+{
+    ledstripStats.brightnessCoeff = brightnessCoeff;
+}
+
+void Assert(bool condition)
+{
+    if (condition) return;
+
+    fprintf(stderr, "glow_host: decode assert failed\n");
+    abort();
+}
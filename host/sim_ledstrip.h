@@ -0,0 +1,52 @@
+/*
+ *  Copyright 2018-2021 ledmaker.org
+ *
+ *  This file is part of Glow Decompiler Lib.
+ *
+ */
+
+#ifndef SIM_LEDSTRIP_H_
+#define SIM_LEDSTRIP_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * Cost model of a simulated ledstrip. Each ProgramLedstrip call transfers a frame of start bytes, bytes per led
+ * and end bytes (APA102 framing by default) at the given bandwidth (zero bandwidth transfers instantly).
+**/
+struct SimLedstripConfig
+{
+    uint32_t bytesPerLed;
+    uint32_t frameStartBytes;
+    uint32_t frameEndBytes;
+    uint32_t bytesPerSec;
+    bool isRealtime;            // whether to also spin for the modeled time, so wall-clock profiles include it.
+    bool isAsync;               // whether pushes of event loop instances complete from a sink thread after the modeled time.
+};
+
+/**
+ * Counters of the simulated ledstrip, and a hash of every pushed frame's color data for comparing renders.
+**/
+struct SimLedstripStats
+{
+    uint64_t numFrames;
+    uint64_t numBytes;
+    uint64_t modeledNs;
+    uint64_t sinkNs;            // wall-clock time spent in ProgramLedstrip (frame hashing and realtime spin).
+    uint64_t frameHash;
+    uint16_t tickIntervalMs;
+    uint16_t brightnessCoeff;
+};
+
+extern void InitSimLedstrip(struct SimLedstripConfig config);
+extern struct SimLedstripStats GetSimLedstripStats();
+
+#ifdef GLOW_ANIMATION_INSTANCES
+/**
+ * Hash of the frames pushed by one animation instance, comparable to the frame hash of a single-animation run.
+**/
+extern uint64_t GetSimLedstripInstanceHash(uint16_t instanceIdx);
+#endif
+
+#endif /* SIM_LEDSTRIP_H_ */
@@ -0,0 +1,342 @@
+/*
+ *  Copyright 2018-2021 ledmaker.org
+ *
+ *  This file is part of Glow Decompiler Lib.
+ *
+ *  Offline analyzer of execution trace dumps: tick durations, per-path summaries and timelines, and hot
+ *  instructions. Times are in trace timestamp units (nanoseconds for dumps written by glow_host).
+ *  Build from the repository root, eg.:
+ *
+ *  cc -O2 -I. -Ihost -DGLOW_TRACE_EVENTS=1 host/trace_analyzer.c -o glow_trace
+ *
+ */
+
+#include "public_api.h"
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "trace_dump.h"
+
+#define NUM_PATHS 0x10000
+#define HOT_INSTR_TABLE_SZ (1 << 18)
+#define DEFAULT_TOP_COUNT 10
+#define NO_TIMELINE_PATH -1
+
+struct PathStats
+{
+    uint64_t numRuns;
+    uint64_t runTime;
+    uint32_t maxRunTime;
+    uint64_t numInstrs;
+    uint64_t numPauses;
+    uint64_t numRamps;
+    uint64_t numFlashReads;
+    uint64_t flashBytes;
+    uint64_t flashTime;
+    const struct TraceEvent *ptrOpenEvent;  // instruction or flash read being timed, NULL if none.
+    const struct TraceEvent *ptrRunEvent;   // path run in progress, NULL if none.
+    uint32_t runInstrs;
+    uint32_t runFlashBytes;
+};
+
+struct HotInstr
+{
+    bool isUsed;
+    uint16_t pathIdx;
+    uint8_t opcode;
+    uint32_t instrBitAddress;
+    uint64_t count;
+    uint64_t totalTime;
+    uint32_t maxTime;
+};
+
+struct TickDuration
+{
+    uint32_t tickIdx;
+    uint32_t duration;
+};
+
+static struct PathStats pathStats[NUM_PATHS];
+static struct HotInstr hotInstrs[HOT_INSTR_TABLE_SZ];
+static uint32_t numHotInstrs;
+
+static const char *GetOpcodeName(uint8_t opcode)
+{
+    switch (opcode)
+    {
+        case 1: return "Here";
+        case 2: return "Goto";
+        case 3: return "Pause";
+        case 4: return "GlowImmediate";
+        case 5: return "GlowRamp";
+        case 6: return "GlowImmediateSpans";
+        case 7: return "GlowRampSpans";
+        case 14: return "PathActivate";
+        case 15: return "PathEnd";
+        default: return "?";
+    }
+}
+
+static void AddHotInstr(const struct TraceEvent *ptrEvent, uint32_t duration)
+{
+    // Open addressing keyed on path and instruction bit address:
+    uint32_t slotIdx = (ptrEvent->value * 0x9E3779B1u ^ ptrEvent->pathIdx * 0x85EBCA77u) % HOT_INSTR_TABLE_SZ;
+    while (hotInstrs[slotIdx].isUsed
+        && (hotInstrs[slotIdx].pathIdx != ptrEvent->pathIdx || hotInstrs[slotIdx].instrBitAddress != ptrEvent->value))
+    {
+        slotIdx = (slotIdx + 1) % HOT_INSTR_TABLE_SZ;
+    }
+
+    struct HotInstr *ptrHotInstr = &hotInstrs[slotIdx];
+    if (!ptrHotInstr->isUsed)
+    {
+        if (numHotInstrs == HOT_INSTR_TABLE_SZ - 1) return;    // table full, keep a free slot to end probing.
+        numHotInstrs++;
+        ptrHotInstr->isUsed = true;
+        ptrHotInstr->pathIdx = ptrEvent->pathIdx;
+        ptrHotInstr->opcode = ptrEvent->opcode;
+        ptrHotInstr->instrBitAddress = ptrEvent->value;
+    }
+    ptrHotInstr->count++;
+    ptrHotInstr->totalTime += duration;
+    if (duration > ptrHotInstr->maxTime) ptrHotInstr->maxTime = duration;
+}
+
+static void CloseOpenEvent(struct PathStats *ptrPath, uint32_t timestamp)
+{
+    const struct TraceEvent *ptrOpenEvent = ptrPath->ptrOpenEvent;
+    if (!ptrOpenEvent) return;
+
+    // Timestamps may wrap, differences stay valid:
+    uint32_t duration = timestamp - ptrOpenEvent->timestamp;
+    if (ptrOpenEvent->type == TraceInstr) AddHotInstr(ptrOpenEvent, duration);
+    else if (ptrOpenEvent->type == TraceFlashRead) ptrPath->flashTime += duration;
+    ptrPath->ptrOpenEvent = NULL;
+}
+
+static int CompareHotInstrs(const void *ptrA, const void *ptrB)
+{
+    const struct HotInstr *ptrHotA = ptrA, *ptrHotB = ptrB;
+    if (ptrHotA->totalTime != ptrHotB->totalTime) return ptrHotA->totalTime < ptrHotB->totalTime ? 1 : -1;
+    return 0;
+}
+
+static int CompareTickDurations(const void *ptrA, const void *ptrB)
+{
+    const struct TickDuration *ptrTickA = ptrA, *ptrTickB = ptrB;
+    if (ptrTickA->duration != ptrTickB->duration) return ptrTickA->duration < ptrTickB->duration ? 1 : -1;
+    return 0;
+}
+
+static struct TraceEvent *LoadTraceDump(const char *dumpPath, struct TraceDumpHeader *ptrHeader)
+{
+    FILE *dumpFile = fopen(dumpPath, "rb");
+    if (!dumpFile) return NULL;
+
+    struct TraceEvent *ptrEvents = NULL;
+    if (fread(ptrHeader, sizeof(*ptrHeader), 1, dumpFile) == 1
+        && memcmp(ptrHeader->magic, TRACE_DUMP_MAGIC, sizeof(ptrHeader->magic)) == 0
+        && ptrHeader->version == TRACE_DUMP_VERSION
+        && ptrHeader->eventSz == sizeof(struct TraceEvent))
+    {
+        ptrEvents = malloc((size_t)ptrHeader->numEvents * sizeof(struct TraceEvent) + 1);
+        if (ptrEvents && fread(ptrEvents, sizeof(struct TraceEvent), ptrHeader->numEvents, dumpFile) != ptrHeader->numEvents)
+        {
+            free(ptrEvents);
+            ptrEvents = NULL;
+        }
+    }
+    fclose(dumpFile);
+
+    return ptrEvents;
+}
+
+static void PrintRun(const struct PathStats *ptrPath, uint32_t tickIdx, uint32_t tickStartTimestamp,
+    const struct TraceEvent *ptrStopEvent, const char *ptrNotes)
+{
+    const struct TraceEvent *ptrRunEvent = ptrPath->ptrRunEvent;
+    printf("  tick %8u  +%-10u run %-10u instrs %-5u from bit %-8u to bit %-8u%s", tickIdx,
+        ptrRunEvent->timestamp - tickStartTimestamp, ptrStopEvent->timestamp - ptrRunEvent->timestamp,
+        ptrPath->runInstrs, ptrRunEvent->value, ptrStopEvent->value, ptrNotes);
+    if (ptrPath->runFlashBytes) printf(" flash %uB", ptrPath->runFlashBytes);
+    printf("\n");
+}
+
+int main(int argc, char **argv)
+{
+    static const struct option options[] =
+    {
+        { "top", required_argument, NULL, 'n' },
+        { "timeline", required_argument, NULL, 'p' },
+        { NULL, 0, NULL, 0 }
+    };
+    uint32_t topCount = DEFAULT_TOP_COUNT;
+    long timelinePathIdx = NO_TIMELINE_PATH;
+    int option;
+
+    while ((option = getopt_long(argc, argv, "", options, NULL)) != -1)
+    {
+        switch (option)
+        {
+            case 'n': topCount = (uint32_t)strtoul(optarg, NULL, 0); break;
+            case 'p': timelinePathIdx = strtol(optarg, NULL, 0); break;
+            default: optind = argc; break;
+        }
+    }
+    if (optind != argc - 1)
+    {
+        fprintf(stderr, "usage: %s [--top N] [--timeline PATH_IDX] trace.bin\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    struct TraceDumpHeader header;
+    struct TraceEvent *ptrEvents = LoadTraceDump(argv[optind], &header);
+    if (!ptrEvents)
+    {
+        fprintf(stderr, "glow_trace: cannot read trace dump %s\n", argv[optind]);
+        return EXIT_FAILURE;
+    }
+
+    struct TickDuration *ptrTicks = malloc((size_t)header.numEvents * sizeof(struct TickDuration) + 1);
+    uint32_t numTicks = 0, tickIdx = 0, tickStartTimestamp = 0;
+    bool isTickOpen = false;
+    char runNotes[64] = "";     // markers seen during the current run of the timeline path.
+    if (timelinePathIdx != NO_TIMELINE_PATH) printf("timeline of path %ld:\n", timelinePathIdx);
+
+    // Replay events in recorded order, timing each instruction until the next event of the same path:
+    for (uint32_t eventIdx = 0; eventIdx < header.numEvents; eventIdx++)
+    {
+        const struct TraceEvent *ptrEvent = &ptrEvents[eventIdx];
+        struct PathStats *ptrPath = &pathStats[ptrEvent->pathIdx];
+        bool isTimelinePath = ptrEvent->pathIdx == timelinePathIdx;
+
+        switch (ptrEvent->type)
+        {
+            case TraceTickStart:
+                tickIdx = ptrEvent->value;
+                tickStartTimestamp = ptrEvent->timestamp;
+                isTickOpen = true;
+                break;
+            case TraceTickEnd:
+                if (isTickOpen && ptrEvent->value == tickIdx)
+                {
+                    ptrTicks[numTicks].tickIdx = tickIdx;
+                    ptrTicks[numTicks].duration = ptrEvent->timestamp - tickStartTimestamp;
+                    numTicks++;
+                }
+                isTickOpen = false;
+                break;
+            case TracePathRun:
+                CloseOpenEvent(ptrPath, ptrEvent->timestamp);
+                ptrPath->ptrRunEvent = ptrEvent;
+                ptrPath->runInstrs = 0;
+                ptrPath->runFlashBytes = 0;
+                if (isTimelinePath) runNotes[0] = '\0';
+                break;
+            case TracePathStop:
+                CloseOpenEvent(ptrPath, ptrEvent->timestamp);
+                if (ptrPath->ptrRunEvent)
+                {
+                    uint32_t runTime = ptrEvent->timestamp - ptrPath->ptrRunEvent->timestamp;
+                    ptrPath->numRuns++;
+                    ptrPath->runTime += runTime;
+                    if (runTime > ptrPath->maxRunTime) ptrPath->maxRunTime = runTime;
+                    if (isTimelinePath) PrintRun(ptrPath, tickIdx, tickStartTimestamp, ptrEvent, runNotes);
+                }
+                ptrPath->ptrRunEvent = NULL;
+                break;
+            case TraceInstr:
+                CloseOpenEvent(ptrPath, ptrEvent->timestamp);
+                ptrPath->ptrOpenEvent = ptrEvent;
+                ptrPath->numInstrs++;
+                ptrPath->runInstrs++;
+                if (isTimelinePath && ptrEvent->opcode == 15) strncat(runNotes, " end", sizeof(runNotes) - strlen(runNotes) - 1);
+                break;
+            case TracePauseStart:
+                ptrPath->numPauses++;
+                if (isTimelinePath)
+                {
+                    size_t notesLen = strlen(runNotes);
+                    snprintf(runNotes + notesLen, sizeof(runNotes) - notesLen, " pause %u", ptrEvent->extra);
+                }
+                break;
+            case TraceRampStart:
+                ptrPath->numRamps++;
+                if (isTimelinePath) strncat(runNotes, " ramp-start", sizeof(runNotes) - strlen(runNotes) - 1);
+                break;
+            case TraceRampEnd:
+                if (isTimelinePath) strncat(runNotes, " ramp-end", sizeof(runNotes) - strlen(runNotes) - 1);
+                break;
+            case TraceFlashRead:
+                // Flash reads within an instruction are timed separately from it:
+                if (ptrEvent->pathIdx != TRACE_NO_PATH)
+                {
+                    CloseOpenEvent(ptrPath, ptrEvent->timestamp);
+                    ptrPath->ptrOpenEvent = ptrEvent;
+                }
+                ptrPath->numFlashReads++;
+                ptrPath->flashBytes += ptrEvent->value;
+                ptrPath->runFlashBytes += ptrEvent->value;
+                break;
+            default:
+                break;
+        }
+    }
+
+    // Summary and slowest ticks:
+    printf("events: %u in dump, %llu recorded (%llu overwritten)\n", header.numEvents,
+        (unsigned long long)header.totalEvents, (unsigned long long)(header.totalEvents - header.numEvents));
+    uint64_t totalTickTime = 0;
+    for (uint32_t idx = 0; idx < numTicks; idx++) totalTickTime += ptrTicks[idx].duration;
+    qsort(ptrTicks, numTicks, sizeof(struct TickDuration), CompareTickDurations);
+    printf("ticks: %u complete, avg %.1f, max %u\n", numTicks, numTicks ? (double)totalTickTime / numTicks : 0.0,
+        numTicks ? ptrTicks[0].duration : 0);
+    printf("\nslowest ticks:\n");
+    for (uint32_t idx = 0; idx < numTicks && idx < topCount; idx++)
+    {
+        printf("  tick %8u  %u\n", ptrTicks[idx].tickIdx, ptrTicks[idx].duration);
+    }
+
+    // Per-path summaries:
+    printf("\n%6s %8s %12s %10s %10s %10s %8s %8s %8s %10s %10s\n", "path", "runs", "run time", "avg run",
+        "max run", "instrs", "pauses", "ramps", "flashes", "flash B", "flash time");
+    for (uint32_t pathIdx = 0; pathIdx < NUM_PATHS; pathIdx++)
+    {
+        const struct PathStats *ptrPath = &pathStats[pathIdx];
+        if (!ptrPath->numRuns && !ptrPath->numFlashReads) continue;
+
+        char pathName[8];
+        if (pathIdx == TRACE_NO_PATH) snprintf(pathName, sizeof(pathName), "-");
+        else snprintf(pathName, sizeof(pathName), "%u", pathIdx);
+        printf("%6s %8llu %12llu %10.1f %10u %10llu %8llu %8llu %8llu %10llu %10llu\n", pathName,
+            (unsigned long long)ptrPath->numRuns, (unsigned long long)ptrPath->runTime,
+            ptrPath->numRuns ? (double)ptrPath->runTime / ptrPath->numRuns : 0.0, ptrPath->maxRunTime,
+            (unsigned long long)ptrPath->numInstrs, (unsigned long long)ptrPath->numPauses,
+            (unsigned long long)ptrPath->numRamps, (unsigned long long)ptrPath->numFlashReads,
+            (unsigned long long)ptrPath->flashBytes, (unsigned long long)ptrPath->flashTime);
+    }
+
+    // Hot instructions by total time:
+    uint32_t numUsed = 0;
+    for (uint32_t slotIdx = 0; slotIdx < HOT_INSTR_TABLE_SZ; slotIdx++)
+    {
+        if (hotInstrs[slotIdx].isUsed) hotInstrs[numUsed++] = hotInstrs[slotIdx];
+    }
+    qsort(hotInstrs, numUsed, sizeof(struct HotInstr), CompareHotInstrs);
+    printf("\nhot instructions:\n%6s %10s %-20s %10s %12s %10s %10s\n", "path", "bit addr", "opcode", "count",
+        "total", "avg", "max");
+    for (uint32_t idx = 0; idx < numUsed && idx < topCount; idx++)
+    {
+        const struct HotInstr *ptrHotInstr = &hotInstrs[idx];
+        printf("%6u %10u %-20s %10llu %12llu %10.1f %10u\n", ptrHotInstr->pathIdx, ptrHotInstr->instrBitAddress,
+            GetOpcodeName(ptrHotInstr->opcode), (unsigned long long)ptrHotInstr->count,
+            (unsigned long long)ptrHotInstr->totalTime, (double)ptrHotInstr->totalTime / ptrHotInstr->count,
+            ptrHotInstr->maxTime);
+    }
+
+    free(ptrTicks);
+    free(ptrEvents);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,29 @@
+/*
+ *  Copyright 2018-2021 ledmaker.org
+ *
+ *  This file is part of Glow Decompiler Lib.
+ *
+ */
+
+#ifndef TRACE_DUMP_H_
+#define TRACE_DUMP_H_
+
+#include <stdint.h>
+
+#define TRACE_DUMP_MAGIC "GLTR"
+#define TRACE_DUMP_VERSION 2
+
+/**
+ * Header of a trace dump file, followed by numEvents struct TraceEvent records (oldest first, host byte order).
+ * Timestamps written by glow_host are nanoseconds.
+**/
+struct TraceDumpHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t eventSz;
+    uint32_t numEvents;
+    uint64_t totalEvents;       // events recorded, including those overwritten before the dump.
+};
+
+#endif /* TRACE_DUMP_H_ */
@@ -11,13 +11,53 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include "ledstrip_buffer.h"
+#include "render_ahead.h"
 
+#ifdef GLOW_APPLY_WORKERS
+#include "parallel_apply.h"
+_Alignas(CACHE_LINE_SZ) struct Led Leds[LED_COUNT];  // parallel apply ranges start on cache line boundaries.
+#else
 struct Led Leds[LED_COUNT];
+#endif
 struct LedstripBuffer ledstripBuffer = { .leds = Leds, .numLeds = LED_COUNT, .isDirty = false };
 
+#ifdef GLOW_PLANAR_LEDS
+struct PlanarLeds planarLeds;
+#endif
+
+#ifdef GLOW_PLAYLIST_STAGING_BUF_SZ
+static struct Led crossfadeFromLeds[LED_COUNT];
+static struct Led crossfadeLeds[LED_COUNT];
+static struct LedstripBuffer crossfadeBuffer = { .leds = crossfadeLeds, .numLeds = LED_COUNT, .isDirty = false };
+static uint8_t crossfadeTicks;
+static uint8_t crossfadeTicksCounter;
+#endif
+
+#ifdef GLOW_PLANAR_LEDS
+static void InterleaveLeds()
+{
+    // Write the led array directly rather than through the buffer pointer, so the loop vectorizes:
+    for (uint16_t ledIdx = 0; ledIdx < LED_COUNT; ledIdx++)
+    {
+        Leds[ledIdx].red = planarLeds.red[ledIdx];
+        Leds[ledIdx].green = planarLeds.green[ledIdx];
+        Leds[ledIdx].blue = planarLeds.blue[ledIdx];
+        Leds[ledIdx].bright = planarLeds.bright[ledIdx];
+    }
+}
+#endif
+
 void SetLedstripTestColor(uint8_t red, uint8_t green, uint8_t blue, uint8_t bright)
 {
     // Set default color data:
+#ifdef GLOW_PLANAR_LEDS
+    memset(planarLeds.red, red, LED_COUNT);
+    memset(planarLeds.green, green, LED_COUNT);
+    memset(planarLeds.blue, blue, LED_COUNT);
+    memset(planarLeds.bright, bright, LED_COUNT);
+    InterleaveLeds();
+#else
     for (uint16_t ledIdx = 0; ledIdx < LED_COUNT; ledIdx++)
     {
         ledstripBuffer.leds[ledIdx].red = red;
@@ -25,8 +65,85 @@ void SetLedstripTestColor(uint8_t red, uint8_t green, uint8_t blue, uint8_t brig
         ledstripBuffer.leds[ledIdx].blue = blue;
         ledstripBuffer.leds[ledIdx].bright = bright;
     }
+#endif
 
     // Push color data to ledstrip:
     ledstripBuffer.isDirty = true;
     ProgramLedstrip(&ledstripBuffer);
-}
\ No newline at end of file
+}
+
+void ClearLedstripBuffer()
+{
+#ifdef GLOW_PLANAR_LEDS
+    memset(&planarLeds, 0, sizeof(planarLeds));
+#else
+    memset(ledstripBuffer.leds, 0, sizeof(struct Led) * ledstripBuffer.numLeds);
+#endif
+    ledstripBuffer.isDirty = true;
+}
+
+static void PushLedstripBuffer(struct LedstripBuffer *ptrLedstripBuffer)
+{
+#ifdef GLOW_RENDER_AHEAD_FRAMES
+    // Every tick decoded by the producer becomes a ring frame, pushed to ledstrip by the consumer on the tick timer:
+    if (IsRenderAheadProducer())
+    {
+        QueueRenderAheadFrame(ptrLedstripBuffer);
+        return;
+    }
+#endif
+
+    if (ptrLedstripBuffer->isDirty) ProgramLedstrip(ptrLedstripBuffer);
+}
+
+#ifdef GLOW_PLAYLIST_STAGING_BUF_SZ
+void StartLedstripCrossfade(uint8_t ticks)
+{
+    memcpy(crossfadeFromLeds, ledstripBuffer.leds, sizeof(crossfadeFromLeds));
+    crossfadeTicks = ticks;
+    crossfadeTicksCounter = 0;
+}
+
+static uint8_t BlendColor(uint8_t fromColor, uint8_t toColor)
+{
+    return (uint8_t)((fromColor * (crossfadeTicks - crossfadeTicksCounter) + toColor * crossfadeTicksCounter) / crossfadeTicks);
+}
+
+static void CommitLedstripCrossfade()
+{
+    // Blend snapshot into current color data, last crossfade tick is entirely current color data:
+    crossfadeTicksCounter++;
+    for (uint16_t ledIdx = 0; ledIdx < LED_COUNT; ledIdx++)
+    {
+        crossfadeLeds[ledIdx].red = BlendColor(crossfadeFromLeds[ledIdx].red, ledstripBuffer.leds[ledIdx].red);
+        crossfadeLeds[ledIdx].green = BlendColor(crossfadeFromLeds[ledIdx].green, ledstripBuffer.leds[ledIdx].green);
+        crossfadeLeds[ledIdx].blue = BlendColor(crossfadeFromLeds[ledIdx].blue, ledstripBuffer.leds[ledIdx].blue);
+        crossfadeLeds[ledIdx].bright = BlendColor(crossfadeFromLeds[ledIdx].bright, ledstripBuffer.leds[ledIdx].bright);
+    }
+
+    crossfadeBuffer.isDirty = true;
+    PushLedstripBuffer(&crossfadeBuffer);
+
+    // Crossfade output replaces this tick's ledstrip update:
+    if (crossfadeTicksCounter == crossfadeTicks) crossfadeTicks = 0;
+    ledstripBuffer.isDirty = false;
+}
+#endif
+
+void CommitLedstripBuffer()
+{
+#ifdef GLOW_PLANAR_LEDS
+    // Interleave color channels once per tick, and only if they changed:
+    if (ledstripBuffer.isDirty) InterleaveLeds();
+#endif
+
+#ifdef GLOW_PLAYLIST_STAGING_BUF_SZ
+    if (crossfadeTicks)
+    {
+        CommitLedstripCrossfade();
+        return;
+    }
+#endif
+
+    PushLedstripBuffer(&ledstripBuffer);
+}
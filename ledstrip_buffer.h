@@ -10,4 +10,56 @@
 
 extern struct LedstripBuffer ledstripBuffer;
 
+#ifdef GLOW_PLANAR_LEDS
+#ifndef CACHE_LINE_SZ
+#define CACHE_LINE_SZ 64
+#endif
+
+// Channel arrays are padded to whole cache lines, so every channel's parallel apply ranges start on a line boundary:
+#define PLANAR_CHANNEL_SZ ((LED_COUNT + CACHE_LINE_SZ - 1) / CACHE_LINE_SZ * CACHE_LINE_SZ)
+
+/**
+ * Planar ledstrip color data with one array per color channel. Decoding writes these arrays, and they are
+ * interleaved into ledstrip buffer color data when a dirty tick is committed.
+**/
+struct PlanarLeds
+{
+    _Alignas(CACHE_LINE_SZ) uint8_t red[PLANAR_CHANNEL_SZ];
+    _Alignas(CACHE_LINE_SZ) uint8_t green[PLANAR_CHANNEL_SZ];
+    _Alignas(CACHE_LINE_SZ) uint8_t blue[PLANAR_CHANNEL_SZ];
+    _Alignas(CACHE_LINE_SZ) uint8_t bright[PLANAR_CHANNEL_SZ];
+};
+extern struct PlanarLeds planarLeds;
+
+#define LedRed(ledIdx) (planarLeds.red[ledIdx])
+#define LedGreen(ledIdx) (planarLeds.green[ledIdx])
+#define LedBlue(ledIdx) (planarLeds.blue[ledIdx])
+#define LedBright(ledIdx) (planarLeds.bright[ledIdx])
+#define SetLed(ledIdx, color) do { LedRed(ledIdx) = (color).red; LedGreen(ledIdx) = (color).green; \
+    LedBlue(ledIdx) = (color).blue; LedBright(ledIdx) = (color).bright; } while (0)
+#else
+#define LedRed(ledIdx) (ledstripBuffer.leds[ledIdx].red)
+#define LedGreen(ledIdx) (ledstripBuffer.leds[ledIdx].green)
+#define LedBlue(ledIdx) (ledstripBuffer.leds[ledIdx].blue)
+#define LedBright(ledIdx) (ledstripBuffer.leds[ledIdx].bright)
+#define SetLed(ledIdx, color) (ledstripBuffer.leds[ledIdx] = (color))
+#endif
+
+/**
+ * Turn off all leds in ledstrip buffer without pushing color data to ledstrip.
+**/
+extern void ClearLedstripBuffer();
+
+/**
+ * Push ledstrip buffer color data to ledstrip at the end of an animation tick if it is dirty (or crossfading).
+**/
+extern void CommitLedstripBuffer();
+
+#ifdef GLOW_PLAYLIST_STAGING_BUF_SZ
+/**
+ * Snapshot current ledstrip color data and blend it into the next N committed ticks.
+**/
+extern void StartLedstripCrossfade(uint8_t crossfadeTicks);
+#endif
+
 #endif /* LEDSTRIP_BUFFER_H_ */
\ No newline at end of file
@@ -0,0 +1,123 @@
+/*
+ *  Copyright 2018-2021 ledmaker.org
+ *
+ *  This file is part of Glow Decompiler Lib.
+ *
+ */
+
+#include "public_api.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#ifdef GLOW_APPLY_WORKERS
+
+#include <pthread.h>
+#include "bit_handler.h"
+#include "ledstrip_buffer.h"
+#include "parallel_apply.h"
+#include "worker_pool.h"
+
+#define RED_MASK 0x08
+#define GREEN_MASK 0x04
+#define BLUE_MASK 0x02
+#define BRIGHT_MASK 0x01
+
+#ifdef GLOW_PLANAR_LEDS
+#define LEDS_PER_CACHE_LINE CACHE_LINE_SZ   // one byte per led in each color channel array.
+#else
+#define LEDS_PER_CACHE_LINE (CACHE_LINE_SZ / sizeof(struct Led))
+#endif
+#define MASK_BITS_PER_READ 32
+
+struct ApplyJob
+{
+    uint8_t *ptrInstrBuffer;
+    uint32_t maskBitAddress;
+    uint8_t colorBitmap;
+    struct Led color;
+    uint32_t rangeLen;
+    bool isRangeActive[GLOW_APPLY_WORKERS + 1];
+};
+
+static struct ApplyJob job;
+static pthread_t workers[GLOW_APPLY_WORKERS];
+static struct WorkerPool pool = WORKER_POOL_INITIALIZER(workers);
+
+static void ApplyBitmapMaskRange(uint8_t rangeIdx)
+{
+    uint32_t startLedIdx = (uint32_t)rangeIdx * job.rangeLen;
+    uint32_t endLedIdx = startLedIdx + job.rangeLen;
+    bool isRangeActive = false;
+
+    if (endLedIdx > ledstripBuffer.numLeds) endLedIdx = ledstripBuffer.numLeds;
+
+    // Read mask bits up to 32 leds at a time, first led in most significant bit:
+    for (uint32_t ledIdx = startLedIdx; ledIdx < endLedIdx; ledIdx += MASK_BITS_PER_READ)
+    {
+        uint8_t numBits = (endLedIdx - ledIdx < MASK_BITS_PER_READ) ? endLedIdx - ledIdx : MASK_BITS_PER_READ;
+        uint32_t maskBits = GetBufferBitfieldValue(job.ptrInstrBuffer, job.maskBitAddress + ledIdx, numBits);
+        if (!maskBits) continue;
+        isRangeActive = true;
+
+        for (uint8_t bitIdx = 0; bitIdx < numBits; bitIdx++)
+        {
+            if (!(maskBits & ((uint32_t)1 << (numBits - 1 - bitIdx)))) continue;
+
+            uint32_t activeLedIdx = ledIdx + bitIdx;
+            if (job.colorBitmap & RED_MASK) LedRed(activeLedIdx) = job.color.red;
+            if (job.colorBitmap & GREEN_MASK) LedGreen(activeLedIdx) = job.color.green;
+            if (job.colorBitmap & BLUE_MASK) LedBlue(activeLedIdx) = job.color.blue;
+            if (job.colorBitmap & BRIGHT_MASK) LedBright(activeLedIdx) = job.color.bright;
+        }
+    }
+
+    job.isRangeActive[rangeIdx] = isRangeActive;
+}
+
+static void *ApplyWorker(void *arg)
+{
+    uint8_t rangeIdx = (uint8_t)(uintptr_t)arg;
+
+    // Wait until every worker is created, exiting if any could not be:
+    if (!WaitWorkerPoolRelease(&pool)) return NULL;
+
+    while (true)
+    {
+        pthread_barrier_wait(&pool.startBarrier);
+        ApplyBitmapMaskRange(rangeIdx);
+        pthread_barrier_wait(&pool.doneBarrier);
+    }
+
+    return NULL;
+}
+
+bool StartApplyWorkers()
+{
+    // Calling thread applies range zero, each worker applies the range following its index:
+    return StartWorkerPool(&pool, ApplyWorker);
+}
+
+bool ApplyBitmapMaskParallel(uint8_t colorBitmap, struct Led color, uint32_t maskBitAddress)
+{
+    // Split leds into equal ranges rounded up to whole cache lines of led color data:
+    uint32_t rangeLen = (ledstripBuffer.numLeds + GLOW_APPLY_WORKERS) / (GLOW_APPLY_WORKERS + 1);
+    rangeLen = (rangeLen + LEDS_PER_CACHE_LINE - 1) / LEDS_PER_CACHE_LINE * LEDS_PER_CACHE_LINE;
+
+    job.ptrInstrBuffer = GetInstrBufferStartPtr();
+    job.maskBitAddress = maskBitAddress;
+    job.colorBitmap = colorBitmap;
+    job.color = color;
+    job.rangeLen = rangeLen;
+
+    pthread_barrier_wait(&pool.startBarrier);
+    ApplyBitmapMaskRange(0);
+    pthread_barrier_wait(&pool.doneBarrier);
+
+    bool isAnyActive = false;
+    for (uint8_t rangeIdx = 0; rangeIdx <= GLOW_APPLY_WORKERS; rangeIdx++) isAnyActive |= job.isRangeActive[rangeIdx];
+
+    return isAnyActive;
+}
+
+#endif
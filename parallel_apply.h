@@ -0,0 +1,39 @@
+/*
+ *  Copyright 2018-2021 ledmaker.org
+ *
+ *  This file is part of Glow Decompiler Lib.
+ *
+ */
+
+#ifndef PARALLEL_APPLY_H_
+#define PARALLEL_APPLY_H_
+
+#ifndef GLOW_PARALLEL_APPLY_MIN_LEDS
+#define GLOW_PARALLEL_APPLY_MIN_LEDS 4096
+#endif
+
+#ifndef CACHE_LINE_SZ
+#define CACHE_LINE_SZ 64
+#endif
+
+/**
+ * Start the apply worker threads on first call. If any worker cannot be created, the workers already created are
+ * joined and later calls return false.
+ *
+ * return: Whether the workers run, led bitmap masks are applied serially otherwise.
+**/
+extern bool StartApplyWorkers();
+
+/**
+ * Apply color to the leds of a led bitmap mask, split across GLOW_APPLY_WORKERS worker threads (plus the calling
+ * thread) in cache-line-aligned led ranges. Returns once every range is applied. Does not move the bit handler.
+ *
+ * param[in]: colorBitmap: color channels to set.
+ * param[in]: color: color channel values.
+ * param[in]: maskBitAddress: instruction bit address of the first led's mask bit.
+ *
+ * return: Whether any led is active in the mask.
+**/
+extern bool ApplyBitmapMaskParallel(uint8_t colorBitmap, struct Led color, uint32_t maskBitAddress);
+
+#endif /* PARALLEL_APPLY_H_ */
@@ -0,0 +1,292 @@
+/*
+ *  Copyright 2018-2021 ledmaker.org
+ *
+ *  This file is part of Glow Decompiler Lib.
+ *
+ */
+
+#include "public_api.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef GLOW_PATH_WORKERS
+
+#include <pthread.h>
+#include "bit_handler.h"
+#include "decode_metadata.h"
+#include "ledstrip_buffer.h"
+#include "parallel_paths.h"
+#include "worker_pool.h"
+
+#define RED_MASK 0x08
+#define GREEN_MASK 0x04
+#define BLUE_MASK 0x02
+#define BRIGHT_MASK 0x01
+
+#define NUM_SLOTS (GLOW_PATH_WORKERS + 1)
+#define ACTIVATED_LAYER_IDX NUM_SLOTS
+
+struct PathSlot
+{
+    struct PathContext pathContext;
+    bool isUsed;
+};
+
+GLOW_THREAD_LOCAL struct LedLayer *activeLayer = NULL;
+
+static struct LedLayer layers[NUM_SLOTS + 1];   // one layer per batch slot, plus one for paths activated within a batch.
+static struct PathSlot slots[NUM_SLOTS];
+static uint32_t runPaths[MAX_PATHS / 32];       // paths run in current batch.
+static uint32_t pendingPaths[MAX_PATHS / 32];   // paths activated in current batch that have yet to run.
+static pthread_t workers[GLOW_PATH_WORKERS];
+static struct WorkerPool pool = WORKER_POOL_INITIALIZER(workers);
+
+static bool IsPathBitSet(uint32_t *ptrBitmap, uint8_t pathIdx)
+{
+    return ptrBitmap[pathIdx / 32] & ((uint32_t)1 << (pathIdx % 32));
+}
+
+static void SetPathBit(uint32_t *ptrBitmap, uint8_t pathIdx)
+{
+    ptrBitmap[pathIdx / 32] |= (uint32_t)1 << (pathIdx % 32);
+}
+
+static int16_t FindFirstPathBit(uint32_t *ptrBitmap)
+{
+    for (uint8_t wordIdx = 0; wordIdx < MAX_PATHS / 32; wordIdx++)
+    {
+        if (!ptrBitmap[wordIdx]) continue;
+        for (uint8_t bitIdx = 0; bitIdx < 32; bitIdx++)
+        {
+            if (ptrBitmap[wordIdx] & ((uint32_t)1 << bitIdx)) return wordIdx * 32 + bitIdx;
+        }
+    }
+
+    return -1;
+}
+
+void SetLayerLedColor(struct LedLayer *ptrLayer, uint16_t ledIdx, uint8_t colorBitmap, struct Led color)
+{
+    if (!colorBitmap) return;
+
+    if (colorBitmap & RED_MASK) ptrLayer->leds[ledIdx].red = color.red;
+    if (colorBitmap & GREEN_MASK) ptrLayer->leds[ledIdx].green = color.green;
+    if (colorBitmap & BLUE_MASK) ptrLayer->leds[ledIdx].blue = color.blue;
+    if (colorBitmap & BRIGHT_MASK) ptrLayer->leds[ledIdx].bright = color.bright;
+    ptrLayer->colorBitmaps[ledIdx] |= colorBitmap;
+
+    if (ledIdx < ptrLayer->firstLedIdx) ptrLayer->firstLedIdx = ledIdx;
+    if (ledIdx >= ptrLayer->endLedIdx) ptrLayer->endLedIdx = ledIdx + 1;
+    ptrLayer->isDirty = true;
+}
+
+void SetLayerLedRange(struct LedLayer *ptrLayer, uint16_t startLedIdx, uint16_t numLeds, uint8_t colorBitmap, struct Led color)
+{
+    for (uint16_t ledIdx = startLedIdx; ledIdx < startLedIdx + numLeds; ledIdx++)
+    {
+        SetLayerLedColor(ptrLayer, ledIdx, colorBitmap, color);
+    }
+}
+
+void ClearLayer(struct LedLayer *ptrLayer)
+{
+    // Earlier writes of this layer are turned off along with the rest of the ledstrip:
+    if (ptrLayer->endLedIdx > ptrLayer->firstLedIdx)
+    {
+        memset(ptrLayer->colorBitmaps + ptrLayer->firstLedIdx, 0, ptrLayer->endLedIdx - ptrLayer->firstLedIdx);
+    }
+    ptrLayer->firstLedIdx = LED_COUNT;
+    ptrLayer->endLedIdx = 0;
+    ptrLayer->isCleared = true;
+    ptrLayer->isDirty = true;
+}
+
+void DeferPathActivate(struct LedLayer *ptrLayer, uint8_t pathIdx)
+{
+    SetPathBit(ptrLayer->activatedPaths, pathIdx);
+}
+
+static void ComposeLayer(struct LedLayer *ptrLayer)
+{
+    if (ptrLayer->isCleared) ClearLedstripBuffer();
+
+    // Merge touched color channels into ledstrip buffer and reset them for the next batch:
+    for (uint16_t ledIdx = ptrLayer->firstLedIdx; ledIdx < ptrLayer->endLedIdx; ledIdx++)
+    {
+        uint8_t colorBitmap = ptrLayer->colorBitmaps[ledIdx];
+        if (!colorBitmap) continue;
+
+        if (colorBitmap & RED_MASK) LedRed(ledIdx) = ptrLayer->leds[ledIdx].red;
+        if (colorBitmap & GREEN_MASK) LedGreen(ledIdx) = ptrLayer->leds[ledIdx].green;
+        if (colorBitmap & BLUE_MASK) LedBlue(ledIdx) = ptrLayer->leds[ledIdx].blue;
+        if (colorBitmap & BRIGHT_MASK) LedBright(ledIdx) = ptrLayer->leds[ledIdx].bright;
+        ptrLayer->colorBitmaps[ledIdx] = 0;
+    }
+
+    if (ptrLayer->isDirty) ledstripBuffer.isDirty = true;
+
+    ptrLayer->firstLedIdx = LED_COUNT;
+    ptrLayer->endLedIdx = 0;
+    ptrLayer->isCleared = false;
+    ptrLayer->isDirty = false;
+}
+
+static void ApplyDeferredActivations(struct LedLayer *ptrLayer, uint8_t activatorPathIdx, uint16_t walkEndPathIdx)
+{
+    for (uint16_t pathIdx = 0; pathIdx < gContext.totalPaths_Value; pathIdx++)
+    {
+        if (!IsPathBitSet(ptrLayer->activatedPaths, pathIdx)) continue;
+
+        if (pathIdx > activatorPathIdx && pathIdx < walkEndPathIdx)
+        {
+            // Sequential decoding would run an ended path activated from a lower path index later this tick.
+            // Paths already run this tick were not ended when activated, so their activation is dropped:
+            if (!IsPathBitSet(runPaths, pathIdx) && GetContextBitfieldValue(pContext.isEndedBitfield_BitAddress + pathIdx, 1))
+            {
+                SetPathEnded(pathIdx, false);
+                SetPathBit(pendingPaths, pathIdx);
+            }
+        }
+        else if (pathIdx != activatorPathIdx)
+        {
+            SetPathEnded(pathIdx, false);
+        }
+    }
+
+    memset(ptrLayer->activatedPaths, 0, sizeof(ptrLayer->activatedPaths));
+}
+
+static void RunSlot(uint8_t slotIdx)
+{
+    if (!slots[slotIdx].isUsed) return;
+
+    pContext = slots[slotIdx].pathContext;
+    activeLayer = &layers[slotIdx];
+    InitInstrBitHandler(ptrSramBufferStart + gContext.contextRegionByteLen_Value + pContext.pathStartByteAddress_Value);
+    RunPathInstructions(false);
+    activeLayer = NULL;
+}
+
+static void RunActivatedPath(uint8_t pathIdx)
+{
+    // Revisit path's metadata-block now that it is no longer ended:
+    if (LoadPathContext(pathIdx, false))
+    {
+        activeLayer = &layers[ACTIVATED_LAYER_IDX];
+        RunPathInstructions(false);
+        activeLayer = NULL;
+    }
+}
+
+static void ComposeBatch(uint8_t numSlots, uint16_t walkEndPathIdx)
+{
+    uint8_t slotIdx = 0;
+
+    // Compose batch layers and paths activated within the batch in path index order:
+    while (true)
+    {
+        int16_t pendingPathIdx = FindFirstPathBit(pendingPaths);
+
+        if (slotIdx < numSlots && (pendingPathIdx < 0 || slots[slotIdx].pathContext.pathIdx_Value < pendingPathIdx))
+        {
+            ComposeLayer(&layers[slotIdx]);
+            ApplyDeferredActivations(&layers[slotIdx], slots[slotIdx].pathContext.pathIdx_Value, walkEndPathIdx);
+            slotIdx++;
+        }
+        else if (pendingPathIdx >= 0)
+        {
+            pendingPaths[pendingPathIdx / 32] &= ~((uint32_t)1 << (pendingPathIdx % 32));
+            SetPathBit(runPaths, pendingPathIdx);
+            RunActivatedPath(pendingPathIdx);
+            ComposeLayer(&layers[ACTIVATED_LAYER_IDX]);
+            ApplyDeferredActivations(&layers[ACTIVATED_LAYER_IDX], pendingPathIdx, walkEndPathIdx);
+        }
+        else
+        {
+            break;
+        }
+    }
+}
+
+static void *PathWorker(void *arg)
+{
+    uint8_t slotIdx = (uint8_t)(uintptr_t)arg;
+
+    // Wait until every worker is created, exiting if any could not be:
+    if (!WaitWorkerPoolRelease(&pool)) return NULL;
+
+    while (true)
+    {
+        pthread_barrier_wait(&pool.startBarrier);
+        RunSlot(slotIdx);
+        pthread_barrier_wait(&pool.doneBarrier);
+    }
+
+    return NULL;
+}
+
+bool StartPathWorkers()
+{
+    if (pool.isPoolStarted || pool.isPoolFailed) return pool.isPoolStarted;
+
+    for (uint8_t layerIdx = 0; layerIdx <= NUM_SLOTS; layerIdx++)
+    {
+        layers[layerIdx].firstLedIdx = LED_COUNT;
+        layers[layerIdx].endLedIdx = 0;
+    }
+
+    // Calling thread runs slot zero, each worker runs the slot following its index:
+    return StartWorkerPool(&pool, PathWorker);
+}
+
+void RunPathsParallel()
+{
+    uint16_t walkPathIdx = 0;
+
+    while (walkPathIdx < gContext.totalPaths_Value)
+    {
+        uint8_t numSlots = 0;
+        memset(runPaths, 0, sizeof(runPaths));
+
+        // Walk active paths' metadata-blocks until every slot holds a runnable path:
+        while (numSlots < NUM_SLOTS)
+        {
+            int16_t pathIdx = FindNextActivePath(walkPathIdx);
+            if (pathIdx < 0)
+            {
+                walkPathIdx = gContext.totalPaths_Value;
+                break;
+            }
+
+            if (LoadPathContext(pathIdx, false))
+            {
+                slots[numSlots].pathContext = pContext;
+                SetPathBit(runPaths, pathIdx);
+                numSlots++;
+            }
+            walkPathIdx = pathIdx + 1;
+        }
+
+        for (uint8_t slotIdx = 0; slotIdx < NUM_SLOTS; slotIdx++) slots[slotIdx].isUsed = (slotIdx < numSlots);
+
+        // Decode batch paths concurrently, leaving a lone runnable path to the calling thread:
+        if (numSlots > 1)
+        {
+            pthread_barrier_wait(&pool.startBarrier);
+            RunSlot(0);
+            pthread_barrier_wait(&pool.doneBarrier);
+        }
+        else
+        {
+            RunSlot(0);
+        }
+
+        ComposeBatch(numSlots, walkPathIdx);
+    }
+
+    pContext.pathIdx_Value = 0;
+}
+
+#endif
@@ -0,0 +1,57 @@
+/*
+ *  Copyright 2018-2021 ledmaker.org
+ *
+ *  This file is part of Glow Decompiler Lib.
+ *
+ */
+
+#ifndef PARALLEL_PATHS_H_
+#define PARALLEL_PATHS_H_
+
+#ifdef GLOW_PATH_WORKERS
+
+/**
+ * Sparse ledstrip layer that one path decodes into while paths run in parallel.
+**/
+struct LedLayer
+{
+    struct Led leds[LED_COUNT];
+    uint8_t colorBitmaps[LED_COUNT];            // color channels set per led, zero if led is untouched.
+    uint16_t firstLedIdx;                       // start of touched led range.
+    uint16_t endLedIdx;                         // end of touched led range (exclusive).
+    bool isCleared;                             // whether all leds were turned off before touched leds were set.
+    bool isDirty;
+    uint32_t activatedPaths[MAX_PATHS / 32];    // path activations deferred until layer composition.
+};
+
+/**
+ * Layer of the path decoded by the calling thread, NULL when decoding straight into the ledstrip buffer.
+**/
+extern GLOW_THREAD_LOCAL struct LedLayer *activeLayer;
+
+/**
+ * Record led color channel writes, a turn-off of all leds or a path activation in a layer.
+**/
+extern void SetLayerLedColor(struct LedLayer *ptrLayer, uint16_t ledIdx, uint8_t colorBitmap, struct Led color);
+extern void SetLayerLedRange(struct LedLayer *ptrLayer, uint16_t startLedIdx, uint16_t numLeds, uint8_t colorBitmap, struct Led color);
+extern void ClearLayer(struct LedLayer *ptrLayer);
+extern void DeferPathActivate(struct LedLayer *ptrLayer, uint8_t pathIdx);
+
+/**
+ * Start the path worker threads on first call. If any worker cannot be created, the workers already created are
+ * joined and later calls return false.
+ *
+ * return: Whether the workers run, paths are decoded serially otherwise.
+**/
+extern bool StartPathWorkers();
+
+/**
+ * Run one tick of all runnable paths (SRAM region only), once StartPathWorkers has succeeded. Runnable paths are decoded in batches of
+ * GLOW_PATH_WORKERS + 1 paths, each into its own layer, and the layers are composed into the ledstrip buffer
+ * in path index order so that the result matches decoding the paths one after another.
+**/
+extern void RunPathsParallel();
+
+#endif
+
+#endif /* PARALLEL_PATHS_H_ */
@@ -0,0 +1,204 @@
+/*
+ *  Copyright 2018-2021 ledmaker.org
+ *
+ *  This file is part of Glow Decompiler Lib.
+ *
+ */
+
+#include "public_api.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bit_handler.h"
+#include "context_pager.h"
+#include "decode_metadata.h"
+#include "ledstrip_buffer.h"
+#include "trace.h"
+#include "verify_animation.h"
+
+#if defined(GLOW_PLAYLIST_STAGING_BUF_SZ) && defined(NVM_BUF_START_ADDR)
+
+#ifndef GLOW_PLAYLIST_PRELOAD_CHUNK_SZ
+#define GLOW_PLAYLIST_PRELOAD_CHUNK_SZ 64
+#endif
+
+#define COMMON_DATA_BYTE_LEN 14
+
+#if GLOW_PLAYLIST_STAGING_BUF_SZ < COMMON_DATA_BYTE_LEN
+#error "GLOW_PLAYLIST_STAGING_BUF_SZ must hold metadata-region common data"
+#endif
+
+static uint8_t stagingBuffer[GLOW_PLAYLIST_STAGING_BUF_SZ];
+static const uint32_t *ptrAnimStartAddrs;
+static uint8_t numAnims;
+static uint8_t crossfadeTicks;
+static uint8_t currAnimIdx;
+static uint8_t stagedAnimIdx;
+static uint16_t stagedContextRegionByteLen;
+static uint16_t stagedByteLen;
+static bool isSkipRequested;
+#ifdef GLOW_VERIFY_ANIMATION
+static struct GlobalContext stagedContext;  // common data of staged animation, swapped in for each verification step.
+static bool isStagedContextDecoded;
+static bool isStagedVerified;
+#endif
+
+static void StageAnimation(uint8_t animIdx)
+{
+    stagedAnimIdx = animIdx;
+    stagedContextRegionByteLen = 0;
+    stagedByteLen = 0;
+#ifdef GLOW_VERIFY_ANIMATION
+    isStagedContextDecoded = false;
+    isStagedVerified = false;
+#endif
+}
+
+#ifdef GLOW_VERIFY_ANIMATION
+static bool VerifyStagedAnimation()
+{
+    struct GlobalContext playingContext = gContext;
+    struct PathContext playingPathContext = pContext;
+#ifdef GLOW_CONTEXT_PAGES
+    bool isPlayingPaged = IsContextPaged();
+    StopContextPager();
+#endif
+    bool isVerified;
+
+    // Swap staged metadata-region in for one verification step:
+    InitContextBitHandler(stagingBuffer);
+    if (isStagedContextDecoded)
+    {
+        gContext = stagedContext;
+        isVerified = VerifyNextAnimationPath(true);
+    }
+    else
+    {
+        gContext.nvmStartAddr = ptrAnimStartAddrs[stagedAnimIdx];
+        isVerified = DecodeContextCommonData(true);
+
+        // Staged paths are loaded past both metadata-regions, into sram that playing paths are reloaded into each tick:
+        if (gContext.contextSramByteLen < playingContext.contextSramByteLen) gContext.contextSramByteLen = playingContext.contextSramByteLen;
+        isVerified = isVerified && StartVerifyAnimation(true);
+        isStagedContextDecoded = true;
+    }
+    isStagedVerified = isVerified && IsAnimationVerified();
+    stagedContext = gContext;
+
+    // Swap playing animation back in:
+    gContext = playingContext;
+    pContext = playingPathContext;
+    InitContextBitHandler(ptrSramBufferStart);
+#ifdef GLOW_CONTEXT_PAGES
+    if (isPlayingPaged) ResumeContextPager();
+#endif
+    InitInstrBitHandler(ptrSramBufferStart + gContext.contextSramByteLen);
+
+    return isVerified;
+}
+#endif
+
+static bool PreloadNextAnimation()
+{
+    uint32_t nvmStartAddr = ptrAnimStartAddrs[stagedAnimIdx];
+
+    if (stagedContextRegionByteLen == 0)
+    {
+        // Load known portion of metadata-region common data and decode its opcode and length:
+        TraceRecord(TraceFlashRead, TRACE_NO_PATH, 0, COMMON_DATA_BYTE_LEN, nvmStartAddr);
+        FlashRead(nvmStartAddr, stagingBuffer, COMMON_DATA_BYTE_LEN);
+        uint16_t contextRegionByteLen = ((stagingBuffer[0] & 0x0F) << 12) | (stagingBuffer[1] << 4) | (stagingBuffer[2] >> 4);
+
+        if (((stagingBuffer[0] >> 4) != Pc2Dev_ContextRegion && (stagingBuffer[0] >> 4) != Pc2Dev_PackedContextRegion)
+            || contextRegionByteLen < COMMON_DATA_BYTE_LEN
+            || contextRegionByteLen > GLOW_PLAYLIST_STAGING_BUF_SZ)
+        {
+            StageAnimation((stagedAnimIdx + 1) % numAnims);  // skip invalid/missing animation.
+            return false;
+        }
+
+        stagedContextRegionByteLen = contextRegionByteLen;
+        stagedByteLen = COMMON_DATA_BYTE_LEN;
+    }
+    else if (stagedByteLen < stagedContextRegionByteLen)
+    {
+        // Load next chunk of metadata-region:
+        uint16_t chunkByteLen = stagedContextRegionByteLen - stagedByteLen;
+        if (chunkByteLen > GLOW_PLAYLIST_PRELOAD_CHUNK_SZ) chunkByteLen = GLOW_PLAYLIST_PRELOAD_CHUNK_SZ;
+        TraceRecord(TraceFlashRead, TRACE_NO_PATH, 0, chunkByteLen, nvmStartAddr + stagedByteLen);
+        FlashRead(nvmStartAddr + stagedByteLen, stagingBuffer + stagedByteLen, chunkByteLen);
+        stagedByteLen += chunkByteLen;
+    }
+#ifdef GLOW_VERIFY_ANIMATION
+    else if (!isStagedVerified)
+    {
+        // Verify one path of the fully staged animation per tick:
+        if (!VerifyStagedAnimation())
+        {
+            StageAnimation((stagedAnimIdx + 1) % numAnims);  // skip animation that fails verification.
+            return false;
+        }
+    }
+
+    return isStagedVerified;
+#else
+    return stagedByteLen == stagedContextRegionByteLen;
+#endif
+}
+
+static void SwitchAnimation()
+{
+    // Keep last frame on ledstrip (or crossfade from it) while the next animation starts from all leds off:
+    if (crossfadeTicks) StartLedstripCrossfade(crossfadeTicks);
+    ClearLedstripBuffer();
+
+    memcpy(ptrSramBufferStart, stagingBuffer, stagedContextRegionByteLen);
+    gContext.nvmStartAddr = ptrAnimStartAddrs[stagedAnimIdx];
+
+    // Staged metadata-region was checked (and verified) while preloading, so loading it from sram cannot fail:
+    LoadAnimationContext(true, true);
+    currAnimIdx = stagedAnimIdx;
+
+    StageAnimation((stagedAnimIdx + 1) % numAnims);
+}
+
+bool InitPlaylist(const uint32_t *animStartAddrs, uint8_t animCount, uint8_t crossfadeTickCount)
+{
+    if (animCount == 0) return false;
+
+    ptrAnimStartAddrs = animStartAddrs;
+    numAnims = animCount;
+    crossfadeTicks = crossfadeTickCount;
+    currAnimIdx = 0;
+    isSkipRequested = false;
+
+    gContext.nvmStartAddr = ptrAnimStartAddrs[currAnimIdx];
+    if (!LoadAnimationContext(true, false)) return false;
+    SetLedstripTestColor(0, 0, 0, 0);   // turn off all leds.
+
+    StageAnimation((currAnimIdx + 1) % numAnims);
+
+    return true;
+}
+
+bool RunPlaylist()
+{
+    bool isRunning = RunAnimation(true);
+
+    // Preload one chunk of the next animation per tick, then switch at this tick boundary when due:
+    if (PreloadNextAnimation() && (isSkipRequested || IsAnimationEnded()))
+    {
+        isSkipRequested = false;
+        SwitchAnimation();
+    }
+
+    return isRunning;
+}
+
+void SkipPlaylistAnimation()
+{
+    isSkipRequested = true;
+}
+
+#endif
@@ -29,6 +29,7 @@
  *
  * GLOW_PROTOCOL_VERSION declares the currently supported Glow protocol version.
  * Corresponds to code file parameter: "device:protocolVersion".
+ * Version 2 adds span-encoded led mask instructions alongside the led bitmap ones.
  *
  * LED_COUNT declares the number of LEDs in the driven ledstrip.
  * Corresponds to glowscript parameter: "device:ledCount".
@@ -42,6 +43,56 @@
  *
  **/
 
+/**
+ * Optional defines (declare externally to this library):
+ *
+ * GLOW_VERIFY_ANIMATION enables a one-pass check of opcodes, field widths, goto targets, led mask lengths and
+ * path indices at initialization. Verified animations are decoded with all per-field asserts compiled out.
+ *
+ * GLOW_PLAYLIST_STAGING_BUF_SZ declares the byte size of a second SRAM region that stages the next playlist
+ * animation's metadata-region, and enables the playlist functions (ROM region only).
+ * GLOW_PLAYLIST_PRELOAD_CHUNK_SZ optionally declares the bytes preloaded per playlist tick (default 64). With
+ * GLOW_VERIFY_ANIMATION, one path of the staged animation is verified per tick once its metadata-region is staged,
+ * and an animation that fails verification is skipped while the current one keeps playing.
+ *
+ * GLOW_UNPACK_CHUNK_SZ declares the byte size of the flash read chunk used to stream packed instruction
+ * paths into SRAM (default 32). Animations with a packed instruction region are supported in ROM region only.
+ * Each path is unpacked whole when it runs, so SRAM past the metadata-region must hold the largest unpacked path.
+ *
+ * GLOW_APPLY_WORKERS declares the number of worker threads (pthreads) that apply led bitmap masks alongside the
+ * decoding thread. Used for ledstrips of at least GLOW_PARALLEL_APPLY_MIN_LEDS leds (default 4096).
+ *
+ * GLOW_PATH_WORKERS declares the number of worker threads (pthreads) that decode runnable paths alongside the
+ * calling thread (SRAM region only). Each path decodes into its own layer and layers are composed in path index
+ * order, giving the same ledstrip color data as decoding paths one after another. Leds turned off mid-tick are not
+ * pushed to the ledstrip before the end of the tick.
+ *
+ * GLOW_RENDER_AHEAD_FRAMES declares the number of ledstrip frames (a power of two, at most 128) that a producer
+ * thread (pthreads) decodes ahead of the ledstrip, and enables the render-ahead functions. RunAnimation pushes to the
+ * ledstrip as usual while render-ahead is not started. Leds turned off mid-tick are not pushed to the ledstrip before
+ * the end of the tick.
+ *
+ * GLOW_PLANAR_LEDS stores decoded color data as one array per color channel, so that instructions updating a few
+ * channels of many leds write contiguous bytes. Channels are interleaved into ledstrip buffer color data once per
+ * dirty tick, before it is pushed to the ledstrip.
+ *
+ * GLOW_TRACE_EVENTS declares the number (a power of two) of fixed-size events held by the execution trace ring, and
+ * enables trace recording and the trace functions. Once the ring is full, the oldest events are overwritten.
+ *
+ * GLOW_CONTEXT_PAGES declares the number (at most 254) of metadata-region pages resident in SRAM (ROM region only).
+ * A metadata-region larger than these pages is paged in from flash on demand instead of being cached whole, leaving
+ * the rest of SRAM for path instructions. Evicted pages with mutated path counters are written back with SwapWrite.
+ * The library never writes flash, so paging moves metadata-region RAM out of SRAM rather than removing it: the swap
+ * store behind SwapWrite/SwapRead (eg. external RAM) needs up to the metadata-region byte length, while SRAM holds
+ * GLOW_CONTEXT_PAGES pages. GLOW_CONTEXT_PAGE_SZ optionally declares the page byte size (default 64).
+ *
+ * GLOW_ANIMATION_INSTANCES declares the number of animation instances that one thread can run tick by tick, each
+ * with its own SRAM buffer and ledstrip color data, and enables the animation instance functions. Decoder state is
+ * swapped in before each instance tick. Not combined with playlists, render-ahead, GLOW_CONTEXT_PAGES or
+ * GLOW_PLANAR_LEDS.
+ *
+ **/
+
 
 /**
  * Glow Decompiler Lib function that initializes a animation by loading it's metadata into cache and performing a
@@ -67,6 +118,176 @@ extern bool InitAnimation(bool isSaveToRom);
  **/
 extern bool RunAnimation(bool isSaveToRom);
 
+/**
+ * Glow Decompiler Lib function that seeds the random color values of glow instructions with the random value action.
+ * Random values are drawn per led from the seed, the tick number since initialization, the path and the instruction,
+ * so an animation renders identically for the same seed regardless of decode threading. Default seed is zero.
+ *
+ * param[in]: seed: Random value seed.
+ **/
+extern void SetRandomSeed(uint32_t seed);
+
+#ifdef GLOW_PLAYLIST_STAGING_BUF_SZ
+/**
+ * Glow Decompiler Lib function that initializes a playlist of animations stored in the ROM region and
+ * initializes the first one. Prior to calling this function, all animation binary data must be present in ROM.
+ *
+ * param[in]: animStartAddrs: Flash start byte address of each animation. Must stay valid while the playlist runs.
+ * param[in]: animCount: Number of animations in playlist.
+ * param[in]: crossfadeTickCount: Number of ticks to crossfade between animations, zero to cut directly.
+ *
+ * return: Initialization status of the first animation.
+ **/
+extern bool InitPlaylist(const uint32_t *animStartAddrs, uint8_t animCount, uint8_t crossfadeTickCount);
+
+/**
+ * Glow Decompiler Lib function that executes one tick of the current playlist animation in place of RunAnimation.
+ * Each tick also preloads a bounded chunk of the next animation's metadata. Once the current animation has ended
+ * (or is skipped) and the next one is fully preloaded, the next one takes over at the tick boundary without
+ * turning off the ledstrip in between.
+ *
+ * return: Run status of the current animation.
+ **/
+extern bool RunPlaylist();
+
+/**
+ * Glow Decompiler Lib function that requests a switch to the next playlist animation once it is preloaded.
+ **/
+extern void SkipPlaylistAnimation();
+#endif
+
+#ifdef GLOW_RENDER_AHEAD_FRAMES
+/**
+ * Glow Decompiler Lib function that starts a producer thread calling RunAnimation back to back, each tick decoded
+ * into a ring of GLOW_RENDER_AHEAD_FRAMES frames. The producer waits while the ring is full. Call after the animation
+ * is initialized; RunAnimation must not be called by any other thread until render-ahead is stopped.
+ *
+ * param[in]: isSaveToRom: Must be same value as passed in to initialize animation.
+ *
+ * return: Start status.
+ **/
+extern bool StartRenderAhead(bool isSaveToRom);
+
+/**
+ * Glow Decompiler Lib function that stops and joins the producer thread. Undelivered frames are discarded, and
+ * PushRenderAheadFrame pushes nothing until render-ahead is started again. Call from the thread calling
+ * PushRenderAheadFrame.
+ **/
+extern void StopRenderAhead();
+
+/**
+ * Glow Decompiler Lib function that pushes the next decoded frame to the ledstrip (if its color data changed).
+ * Call from a single thread once every tick interval, in place of RunAnimation. If no frame is ready the ledstrip
+ * keeps its last frame for this tick, and later ticks skip ahead to newer frames until the ledstrip is back on
+ * schedule, so frames are never shown more than GLOW_RENDER_AHEAD_FRAMES ticks late.
+ *
+ * return: Whether a decoded frame was ready.
+ **/
+extern bool PushRenderAheadFrame();
+
+/**
+ * Glow Decompiler Lib function that returns the number of decoded frames waiting to be pushed (ring occupancy).
+ * Occupancy that stays near zero means the producer cannot decode ahead of the tick timer.
+ **/
+extern uint8_t GetRenderAheadOccupancy();
+
+/**
+ * Glow Decompiler Lib function that returns the number of ticks since render-ahead started with no frame ready.
+ **/
+extern uint32_t GetRenderAheadUnderruns();
+#endif
+
+#ifdef GLOW_ANIMATION_INSTANCES
+/**
+ * Glow Decompiler Lib function that initializes an animation instance in place of InitAnimation. Instances are
+ * independent animations of LED_COUNT leds, run by a single thread in any order.
+ *
+ * param[in]: instanceIdx: Instance index, below GLOW_ANIMATION_INSTANCES.
+ * param[in]: ptrSramBuffer: SRAM_BUF_SZ bytes of SRAM owned by the instance (holding its animation binary data if
+ *            isSaveToRom is false). Must stay valid while the instance runs. ptrSramBufferStart is pointed at the
+ *            buffer of the instance being initialized or run.
+ * param[in]: nvmStartAddr: Flash start byte address of the instance's animation (ROM region only).
+ * param[in]: isSaveToRom: Specifies whether animation binary data is in ROM region or SRAM region.
+ *
+ * return: Initialization status.
+ **/
+extern bool InitAnimationInstance(uint16_t instanceIdx, uint8_t *ptrSramBuffer, uint32_t nvmStartAddr, bool isSaveToRom);
+
+/**
+ * Glow Decompiler Lib function that executes one tick of an animation instance in place of RunAnimation. The
+ * instance's ledstrip color data is pushed through ProgramLedstrip as usual, and stays unchanged until the
+ * instance's next tick.
+ *
+ * return: Run status, as for RunAnimation.
+ **/
+extern bool RunAnimationInstance(uint16_t instanceIdx);
+
+/**
+ * Glow Decompiler Lib function that returns the index of the instance being initialized or run, so that
+ * ProgramLedstrip, SetTickInterval and SaveBrightnessCoefficient can tell instances apart.
+ **/
+extern uint16_t GetActiveAnimationInstance();
+
+/**
+ * Glow Decompiler Lib function that returns the tick interval of an initialized animation instance.
+ **/
+extern uint16_t GetAnimationInstanceTickInterval(uint16_t instanceIdx);
+#endif
+
+#ifdef GLOW_TRACE_EVENTS
+/**
+ * Glow Decompiler Lib definition of execution trace event types.
+ **/
+enum TraceEventType
+{
+    TraceTickStart = 0,     // value: tick number.
+    TraceTickEnd = 1,       // value: tick number, recorded after the ledstrip update.
+    TracePathRun = 2,       // value: instruction bit address the path resumes at.
+    TracePathStop = 3,      // value: instruction bit address following the blocking instruction.
+    TraceInstr = 4,         // value: instruction bit address, opcode: instruction opcode.
+    TracePauseStart = 5,    // value: instruction bit address, extra: pause ticks.
+    TraceRampStart = 6,     // value: ramp instruction bit address, extra: ramp ticks.
+    TraceRampEnd = 7,       // value: ramp instruction bit address.
+    TraceFlashRead = 8      // value: byte length, extra: flash address, recorded before the read.
+};
+
+#define TRACE_NO_PATH 0xFFFF
+
+/**
+ * Glow Decompiler Lib definition of a fixed-size (16 byte) execution trace event.
+ **/
+struct TraceEvent
+{
+    uint32_t timestamp;     // GetTraceTimestamp() value when recorded.
+    uint32_t value;
+    uint16_t pathIdx;       // TRACE_NO_PATH for events outside of a path.
+    uint8_t type;           // enum TraceEventType.
+    uint8_t opcode;
+    uint32_t extra;
+};
+
+/**
+ * Glow Decompiler Lib function that copies the most recent trace events, oldest first. Call between ticks.
+ *
+ * param[out]: ptrEvents: destination event buffer.
+ * param[in]: maxEvents: number of events the destination buffer holds.
+ *
+ * return: Number of events copied.
+ **/
+extern uint32_t ReadTraceEvents(struct TraceEvent *ptrEvents, uint32_t maxEvents);
+
+/**
+ * Glow Decompiler Lib function that returns the number of events recorded since start-up, including overwritten ones.
+ **/
+extern uint64_t GetTraceEventCount();
+
+/**
+ * Declaration for your function that returns a free-running timestamp for trace events (any unit, may wrap).
+ * Implement this function externally to the Glow Decompiler Lib when GLOW_TRACE_EVENTS is declared.
+ **/
+extern uint32_t GetTraceTimestamp();
+#endif
+
 /**
  * Glow Decompiler Lib test-function that pushes a single test color to all ledstrip leds.
  **/
@@ -150,6 +371,23 @@ extern void SaveBrightnessCoefficient(uint16_t brightnessCoeff);
  **/
 extern void FlashRead(uint32_t srcAddr, uint8_t *ptrBuffer, uint32_t length);
 
+#ifdef GLOW_CONTEXT_PAGES
+/**
+ * Declarations for your functions that write and read back evicted metadata-region pages (eg. in external RAM).
+ * Implement these functions externally to the Glow Decompiler Lib when GLOW_CONTEXT_PAGES is declared.
+ * The swap store must hold as many bytes as the largest metadata-region (at most 65535), since any page may be
+ * evicted with mutated path counters. Pages never written back are read from flash again instead.
+ *
+ * param[in] swapAddr: byte address of page within the metadata-region.
+ * param[in] ptrBuffer: pointer to page bytes.
+ * param[in] length: number of page bytes.
+ *
+ * return: None
+ **/
+extern void SwapWrite(uint32_t swapAddr, uint8_t *ptrBuffer, uint32_t length);
+extern void SwapRead(uint32_t swapAddr, uint8_t *ptrBuffer, uint32_t length);
+#endif
+
 /**
  * Declaration for your function that implements asserts.
  * Implement this function externally to the Glow Decompiler Lib.
@@ -0,0 +1,177 @@
+/*
+ *  Copyright 2018-2021 ledmaker.org
+ *
+ *  This file is part of Glow Decompiler Lib.
+ *
+ */
+
+#include "public_api.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef GLOW_RENDER_AHEAD_FRAMES
+
+#include <pthread.h>
+#include <semaphore.h>
+#include "bit_handler.h"
+#include "decode_metadata.h"
+#include "parallel_apply.h"
+#include "render_ahead.h"
+
+#if GLOW_RENDER_AHEAD_FRAMES > 128 || (GLOW_RENDER_AHEAD_FRAMES & (GLOW_RENDER_AHEAD_FRAMES - 1)) != 0
+#error "GLOW_RENDER_AHEAD_FRAMES must be a power of two of at most 128"
+#endif
+
+struct RenderAheadFrame
+{
+    struct Led leds[LED_COUNT];
+    struct LedstripBuffer ledstripBuffer;   // points to leds, as passed to ProgramLedstrip.
+};
+
+static struct RenderAheadFrame frames[GLOW_RENDER_AHEAD_FRAMES];
+
+// Free-running frame counters, each written by one side only (frame slot is counter % GLOW_RENDER_AHEAD_FRAMES,
+// which stays in sequence across counter wrap since the ring size is a power of two):
+_Alignas(CACHE_LINE_SZ) static uint32_t producedFrames;
+_Alignas(CACHE_LINE_SZ) static uint32_t consumedFrames;
+static uint32_t lateTicks;          // ticks the ledstrip has fallen behind the decoded frames (consumer only).
+static uint32_t underrunTicks;
+
+static sem_t freeFrames;            // blocks producer while the ring is full.
+static pthread_t producer;
+static bool isProducing = false;
+static _Thread_local bool isProducerThread = false;   // thread-local even without GLOW_PATH_WORKERS.
+static bool isProducerSaveToRom;
+static struct PathContext producerPathContext;
+
+static void *ProduceFrames(void *arg)
+{
+    (void)arg;
+
+    // Path context and instruction bit handler are thread-local when paths decode in parallel:
+    pContext = producerPathContext;
+    InitInstrBitHandler(ptrSramBufferStart + gContext.contextSramByteLen);
+    isProducerThread = true;
+
+    // Decode ticks back to back, each commit waits for a free frame:
+    while (__atomic_load_n(&isProducing, __ATOMIC_ACQUIRE))
+    {
+        RunAnimation(isProducerSaveToRom);
+    }
+
+    return NULL;
+}
+
+bool IsRenderAheadProducer()
+{
+    return isProducerThread;
+}
+
+void QueueRenderAheadFrame(struct LedstripBuffer *ptrLedstripBuffer)
+{
+    // Wait for a free frame, dropping the tick if render-ahead is stopped meanwhile:
+    while (sem_wait(&freeFrames) != 0) { continue; }
+    if (!__atomic_load_n(&isProducing, __ATOMIC_ACQUIRE)) return;
+
+    struct RenderAheadFrame *ptrFrame = &frames[producedFrames % GLOW_RENDER_AHEAD_FRAMES];
+
+    memcpy(ptrFrame->leds, ptrLedstripBuffer->leds, sizeof(ptrFrame->leds));
+    ptrFrame->ledstripBuffer.isDirty = ptrLedstripBuffer->isDirty;
+    ptrLedstripBuffer->isDirty = false;
+
+    // Publish frame after its color data is written:
+    __atomic_store_n(&producedFrames, producedFrames + 1, __ATOMIC_RELEASE);
+}
+
+static void ReleaseFrame()
+{
+    __atomic_store_n(&consumedFrames, consumedFrames + 1, __ATOMIC_RELEASE);
+    sem_post(&freeFrames);
+}
+
+bool StartRenderAhead(bool isSaveToRom)
+{
+    if (isProducing) return false;
+
+    for (uint8_t frameIdx = 0; frameIdx < GLOW_RENDER_AHEAD_FRAMES; frameIdx++)
+    {
+        frames[frameIdx].ledstripBuffer.leds = frames[frameIdx].leds;
+        frames[frameIdx].ledstripBuffer.numLeds = LED_COUNT;
+        frames[frameIdx].ledstripBuffer.isDirty = false;
+    }
+    producedFrames = 0;
+    consumedFrames = 0;
+    lateTicks = 0;
+    underrunTicks = 0;
+
+    if (sem_init(&freeFrames, 0, GLOW_RENDER_AHEAD_FRAMES) != 0) return false;
+
+    isProducerSaveToRom = isSaveToRom;
+    producerPathContext = pContext;
+    isProducing = true;
+    if (pthread_create(&producer, NULL, ProduceFrames, NULL) != 0)
+    {
+        isProducing = false;
+        sem_destroy(&freeFrames);
+        return false;
+    }
+
+    return true;
+}
+
+void StopRenderAhead()
+{
+    if (!isProducing) return;
+
+    // Wake producer in case it waits for a free frame:
+    __atomic_store_n(&isProducing, false, __ATOMIC_RELEASE);
+    sem_post(&freeFrames);
+    pthread_join(producer, NULL);
+    sem_destroy(&freeFrames);
+}
+
+bool PushRenderAheadFrame()
+{
+    if (!isProducing) return false;     // ring is not running (or stopped), nothing to push.
+
+    uint32_t readyFrames = __atomic_load_n(&producedFrames, __ATOMIC_ACQUIRE) - consumedFrames;
+
+    if (!readyFrames)
+    {
+        // Producer fell behind, so ledstrip keeps showing the last pushed frame this tick:
+        underrunTicks++;
+        if (lateTicks < GLOW_RENDER_AHEAD_FRAMES) lateTicks++;
+        return false;
+    }
+
+    // Catch up on late ticks by skipping to a newer frame, so latency stays within the ring depth:
+    bool isDirty = false;
+    while (readyFrames > 1 && lateTicks)
+    {
+        isDirty |= frames[consumedFrames % GLOW_RENDER_AHEAD_FRAMES].ledstripBuffer.isDirty;
+        ReleaseFrame();
+        readyFrames--;
+        lateTicks--;
+    }
+
+    struct RenderAheadFrame *ptrFrame = &frames[consumedFrames % GLOW_RENDER_AHEAD_FRAMES];
+    ptrFrame->ledstripBuffer.isDirty |= isDirty;
+    if (ptrFrame->ledstripBuffer.isDirty) ProgramLedstrip(&ptrFrame->ledstripBuffer);
+    ReleaseFrame();
+
+    return true;
+}
+
+uint8_t GetRenderAheadOccupancy()
+{
+    return (uint8_t)(__atomic_load_n(&producedFrames, __ATOMIC_ACQUIRE) - __atomic_load_n(&consumedFrames, __ATOMIC_ACQUIRE));
+}
+
+uint32_t GetRenderAheadUnderruns()
+{
+    return underrunTicks;
+}
+
+#endif
@@ -0,0 +1,28 @@
+/*
+ *  Copyright 2018-2021 ledmaker.org
+ *
+ *  This file is part of Glow Decompiler Lib.
+ *
+ */
+
+#ifndef RENDER_AHEAD_H_
+#define RENDER_AHEAD_H_
+
+#ifdef GLOW_RENDER_AHEAD_FRAMES
+
+/**
+ * Check whether the calling thread is the render-ahead producer, whose ticks go to the ring.
+**/
+extern bool IsRenderAheadProducer();
+
+/**
+ * Wait for a free ring frame, then copy end-of-tick ledstrip color data into it and publish it to the consumer.
+ * Called by the producer thread once per decoded tick, in place of pushing color data to the ledstrip.
+ *
+ * param[in]: ptrLedstripBuffer: ledstrip color data of the decoded tick. Its dirty flag is cleared.
+**/
+extern void QueueRenderAheadFrame(struct LedstripBuffer *ptrLedstripBuffer);
+
+#endif
+
+#endif /* RENDER_AHEAD_H_ */
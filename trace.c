@@ -0,0 +1,62 @@
+/*
+ *  Copyright 2018-2021 ledmaker.org
+ *
+ *  This file is part of Glow Decompiler Lib.
+ *
+ */
+
+#include "public_api.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#ifdef GLOW_TRACE_EVENTS
+
+#include "trace.h"
+
+#if GLOW_TRACE_EVENTS <= 0 || (GLOW_TRACE_EVENTS & (GLOW_TRACE_EVENTS - 1)) != 0
+#error "GLOW_TRACE_EVENTS must be a power of two"
+#endif
+
+static struct TraceEvent traceEvents[GLOW_TRACE_EVENTS];
+static uint64_t traceEventCount;    // ring slot of next event is count % GLOW_TRACE_EVENTS, 64 bits so it never wraps.
+
+void RecordTraceEvent(uint8_t type, uint16_t pathIdx, uint8_t opcode, uint32_t value, uint32_t extra)
+{
+#ifdef GLOW_PATH_WORKERS
+    // Claim a slot, paths decoded in parallel record concurrently:
+    uint64_t eventIdx = __atomic_fetch_add(&traceEventCount, 1, __ATOMIC_RELAXED);
+#else
+    uint64_t eventIdx = traceEventCount++;
+#endif
+    struct TraceEvent *ptrEvent = &traceEvents[eventIdx % GLOW_TRACE_EVENTS];
+
+    ptrEvent->timestamp = GetTraceTimestamp();
+    ptrEvent->value = value;
+    ptrEvent->pathIdx = pathIdx;
+    ptrEvent->type = type;
+    ptrEvent->opcode = opcode;
+    ptrEvent->extra = extra;
+}
+
+uint32_t ReadTraceEvents(struct TraceEvent *ptrEvents, uint32_t maxEvents)
+{
+    uint64_t eventCount = traceEventCount;
+    uint32_t numEvents = (eventCount < GLOW_TRACE_EVENTS) ? (uint32_t)eventCount : GLOW_TRACE_EVENTS;
+    if (numEvents > maxEvents) numEvents = maxEvents;
+
+    // Copy most recent events, oldest first:
+    for (uint64_t eventIdx = eventCount - numEvents; eventIdx != eventCount; eventIdx++)
+    {
+        *ptrEvents++ = traceEvents[eventIdx % GLOW_TRACE_EVENTS];
+    }
+
+    return numEvents;
+}
+
+uint64_t GetTraceEventCount()
+{
+    return traceEventCount;
+}
+
+#endif
@@ -0,0 +1,24 @@
+/*
+ *  Copyright 2018-2021 ledmaker.org
+ *
+ *  This file is part of Glow Decompiler Lib.
+ *
+ */
+
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#ifdef GLOW_TRACE_EVENTS
+
+/**
+ * Record an execution trace event into the next ring slot. Lock-free and allocation-free, safe to call from
+ * parallel path workers.
+**/
+extern void RecordTraceEvent(uint8_t type, uint16_t pathIdx, uint8_t opcode, uint32_t value, uint32_t extra);
+
+#define TraceRecord(type, pathIdx, opcode, value, extra) RecordTraceEvent(type, pathIdx, opcode, value, extra)
+#else
+#define TraceRecord(type, pathIdx, opcode, value, extra) ((void)0)
+#endif
+
+#endif /* TRACE_H_ */
@@ -0,0 +1,71 @@
+/*
+ *  Copyright 2018-2021 ledmaker.org
+ *
+ *  This file is part of Glow Decompiler Lib.
+ *
+ */
+
+#include "public_api.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bit_handler.h"
+#include "decode_metadata.h"
+#include "trace.h"
+#include "unpack_instruction.h"
+
+#ifndef GLOW_UNPACK_CHUNK_SZ
+#define GLOW_UNPACK_CHUNK_SZ 32
+#endif
+
+#define REPEAT_RUN_FLAG 0x80
+#define REPEAT_RUN_MIN_LEN 2
+
+static uint8_t chunkBuffer[GLOW_UNPACK_CHUNK_SZ];
+
+uint32_t UnpackInstrPath(uint32_t srcAddr, uint32_t srcByteLen, uint8_t *ptrDst, uint32_t dstByteLen)
+{
+    uint32_t srcIdx = 0, dstIdx = 0;
+    uint16_t chunkIdx = 0, chunkByteLen = 0;
+    uint8_t runLen = 0;
+    bool isRepeatRun = false, isControlNext = true;
+
+    while (srcIdx < srcByteLen)
+    {
+        // Refill chunk buffer from flash when exhausted:
+        if (chunkIdx == chunkByteLen)
+        {
+            chunkByteLen = (srcByteLen - srcIdx < GLOW_UNPACK_CHUNK_SZ) ? srcByteLen - srcIdx : GLOW_UNPACK_CHUNK_SZ;
+            TraceRecord(TraceFlashRead, pContext.pathIdx_Value, 0, chunkByteLen, srcAddr + srcIdx);
+            FlashRead(srcAddr + srcIdx, chunkBuffer, chunkByteLen);
+            chunkIdx = 0;
+        }
+
+        uint8_t u8Val = chunkBuffer[chunkIdx++];
+        srcIdx++;
+
+        if (isControlNext)
+        {
+            // Decode control byte:
+            isRepeatRun = u8Val & REPEAT_RUN_FLAG;
+            runLen = isRepeatRun ? (u8Val & ~REPEAT_RUN_FLAG) + REPEAT_RUN_MIN_LEN : u8Val + 1;
+            isControlNext = false;
+        }
+        else if (isRepeatRun)
+        {
+            if (runLen > dstByteLen - dstIdx) return 0;
+            memset(ptrDst + dstIdx, u8Val, runLen);
+            dstIdx += runLen;
+            isControlNext = true;
+        }
+        else
+        {
+            if (dstIdx == dstByteLen) return 0;
+            ptrDst[dstIdx++] = u8Val;
+            isControlNext = (--runLen == 0);
+        }
+    }
+
+    return isControlNext ? dstIdx : 0;  // zero if packed path ends mid-run.
+}
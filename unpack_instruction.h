@@ -0,0 +1,35 @@
+/*
+ *  Copyright 2018-2021 ledmaker.org
+ *
+ *  This file is part of Glow Decompiler Lib.
+ *
+ */
+
+#ifndef UNPACK_INSTR_H_
+#define UNPACK_INSTR_H_
+
+/**
+ * Packed instruction paths are a sequence of runs, each starting with a control byte:
+ * 0x00-0x7F: literal run, the next (control + 1) bytes are copied as is.
+ * 0x80-0xFF: repeat run, the next byte is repeated (control - 0x7E) times.
+ * Metadata-block path start address and length refer to the packed run data in the instruction region,
+ * while instruction bit addresses refer to the unpacked path.
+ *
+ * Only flash reads are bounded by the chunk size: a path is unpacked whole each time it runs, since gotos, pause
+ * resumes and parallel apply workers address the unpacked path at random. Sram following the metadata-region must
+ * hold the largest unpacked path.
+**/
+
+/**
+ * Stream a packed instruction path from flash into sram through a fixed-size chunk buffer.
+ *
+ * param[in]: srcAddr: flash start byte address of packed path.
+ * param[in]: srcByteLen: byte length of packed path.
+ * param[in]: ptrDst: pointer to destination buffer.
+ * param[in]: dstByteLen: byte size of destination buffer.
+ *
+ * return: Byte length of unpacked path, zero if packed path is malformed or exceeds destination buffer.
+**/
+extern uint32_t UnpackInstrPath(uint32_t srcAddr, uint32_t srcByteLen, uint8_t *ptrDst, uint32_t dstByteLen);
+
+#endif /* UNPACK_INSTR_H_ */
@@ -0,0 +1,325 @@
+/*
+ *  Copyright 2018-2021 ledmaker.org
+ *
+ *  This file is part of Glow Decompiler Lib.
+ *
+ */
+
+#include "public_api.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "bit_handler.h"
+#include "decode_instruction.h"
+#include "decode_metadata.h"
+#include "ledstrip_buffer.h"
+#include "verify_animation.h"
+
+#define RED_MASK 0x08
+#define GREEN_MASK 0x04
+#define BLUE_MASK 0x02
+#define BRIGHT_MASK 0x01
+
+#define BITS_PER_BYTE 8
+#define MAX_BITFIELD_WIDTH 32
+
+static uint32_t contextBitLimit;
+static uint32_t instrBitLimit;
+static uint16_t nextPathIdx;                // next path to verify.
+static uint32_t nextContextBlock_BitAddress;
+
+// Bitfield widths of the metadata-block fields that the current path's instructions write back to:
+static uint8_t instrBitAddressBitWidth;
+static uint8_t extraValueBitWidth;
+static uint8_t pauseTicksBitWidth;
+
+static bool IsValueFitting(uint64_t value, uint8_t bitfieldWidth)
+{
+    if (bitfieldWidth >= 64) return true;
+
+    return value < ((uint64_t)1 << bitfieldWidth);
+}
+
+static bool GetNextVerifiedContextBitfieldValue(uint8_t bitfieldWidth, uint32_t *ptrValue)
+{
+    if (GetCurrentContextBitAddress() + bitfieldWidth > contextBitLimit) return false;
+
+    *ptrValue = GetNextContextBitfieldValue(bitfieldWidth);
+
+    return true;
+}
+
+static bool GetNextVerifiedInstrBitfieldValue(uint8_t bitfieldWidth, uint32_t *ptrValue)
+{
+    if (GetCurrentInstrBitAddress() + bitfieldWidth > instrBitLimit) return false;
+
+    *ptrValue = GetNextInstrBitfieldValue(bitfieldWidth);
+
+    return true;
+}
+
+static bool GetNextVerifiedContextField(uint8_t tickOpcodeBitWidth, uint8_t *ptrBitfieldWidth, uint32_t *ptrValue)
+{
+    uint32_t tickOpcode;
+
+    if (!GetNextVerifiedContextBitfieldValue(tickOpcodeBitWidth, &tickOpcode)) return false;
+
+    // 2-bit tick opcodes encode 1-4 byte fields, 3-bit tick opcodes encode 0-4 byte fields:
+    if (tickOpcodeBitWidth == 2) tickOpcode++;
+    if (tickOpcode * BITS_PER_BYTE > MAX_BITFIELD_WIDTH) return false;
+    *ptrBitfieldWidth = tickOpcode * BITS_PER_BYTE;
+
+    return GetNextVerifiedContextBitfieldValue(*ptrBitfieldWidth, ptrValue);
+}
+
+static bool GetNextVerifiedTickValue(uint32_t *ptrValue)
+{
+    uint32_t tickOpcode;
+
+    if (!GetNextVerifiedInstrBitfieldValue(2, &tickOpcode)) return false;
+
+    return GetNextVerifiedInstrBitfieldValue((tickOpcode + 1) * BITS_PER_BYTE, ptrValue);
+}
+
+static bool VerifyLedMask(bool isSpanMask)
+{
+    uint32_t maskEncoding, numSpans, startLedIdx, numLeds, ledStride, numRepeats;
+
+    if (!isSpanMask)
+    {
+        if (GetCurrentInstrBitAddress() + ledstripBuffer.numLeds > instrBitLimit) return false;
+
+        FastForwardInstrBits(ledstripBuffer.numLeds);
+
+        return true;
+    }
+
+    if (!GetNextVerifiedInstrBitfieldValue(2, &maskEncoding)) return false;
+    if (maskEncoding > 1) return false;     // neither spans nor strided spans.
+    if (!GetNextVerifiedInstrBitfieldValue(8, &numSpans)) return false;
+
+    for (uint32_t spanIdx = 0; spanIdx < numSpans; spanIdx++)
+    {
+        ledStride = 0;
+        numRepeats = 1;
+        if (!GetNextVerifiedInstrBitfieldValue(16, &startLedIdx)) return false;
+        if (!GetNextVerifiedInstrBitfieldValue(16, &numLeds)) return false;
+        if (maskEncoding == 1)
+        {
+            if (!GetNextVerifiedInstrBitfieldValue(16, &ledStride)) return false;
+            if (!GetNextVerifiedInstrBitfieldValue(16, &numRepeats)) return false;
+        }
+
+        // Last repeat of span must end within ledstrip:
+        if (numLeds && numRepeats
+            && startLedIdx + (uint64_t)(numRepeats - 1) * ledStride + numLeds > ledstripBuffer.numLeds) return false;
+    }
+
+    return true;
+}
+
+static bool VerifyGlowImmediate(bool isSpanMask)
+{
+    uint32_t colorBitmap, actionOpcode, value;
+
+    if (!GetNextVerifiedInstrBitfieldValue(4, &colorBitmap)) return false;
+    if (!GetNextVerifiedInstrBitfieldValue(2, &actionOpcode)) return false;
+
+    // Only absolute and random value actions are decoded, random values have no value fields:
+    if (actionOpcode == 2) return false;
+    if (actionOpcode == 3) return VerifyLedMask(isSpanMask);
+
+    if ((colorBitmap & RED_MASK) && !GetNextVerifiedInstrBitfieldValue(8, &value)) return false;
+    if ((colorBitmap & GREEN_MASK) && !GetNextVerifiedInstrBitfieldValue(8, &value)) return false;
+    if ((colorBitmap & BLUE_MASK) && !GetNextVerifiedInstrBitfieldValue(8, &value)) return false;
+    if ((colorBitmap & BRIGHT_MASK) && !GetNextVerifiedInstrBitfieldValue(5, &value)) return false;
+
+    return VerifyLedMask(isSpanMask);
+}
+
+static bool VerifyGlowRampColor()
+{
+    uint32_t colorVal, incDecOp, tickStep, colorStep;
+
+    if (!GetNextVerifiedInstrBitfieldValue(8, &colorVal)) return false;
+    if (!GetNextVerifiedInstrBitfieldValue(2, &incDecOp)) return false;
+    if (incDecOp == 0) return true;
+    if (incDecOp == 3) return false;    // neither increment nor decrement.
+
+    if (!GetNextVerifiedTickValue(&tickStep)) return false;
+    if (tickStep == 0) return false;    // tick step is a divisor.
+
+    return GetNextVerifiedInstrBitfieldValue(8, &colorStep);
+}
+
+static bool VerifyGlowRamp(uint32_t glowRampStartBitAddress, bool isSpanMask)
+{
+    uint32_t rampTicksVal, colorBitmap;
+
+    if (!GetNextVerifiedTickValue(&rampTicksVal)) return false;
+    if (!GetNextVerifiedInstrBitfieldValue(4, &colorBitmap)) return false;
+
+    // Ramp saves its tick counter, a single pause tick and its own bit address to the metadata-block:
+    if (!IsValueFitting((uint64_t)rampTicksVal + 1, extraValueBitWidth)) return false;
+    if (!IsValueFitting(1, pauseTicksBitWidth)) return false;
+    if (!IsValueFitting(glowRampStartBitAddress, instrBitAddressBitWidth)) return false;
+
+    if ((colorBitmap & RED_MASK) && !VerifyGlowRampColor()) return false;
+    if ((colorBitmap & GREEN_MASK) && !VerifyGlowRampColor()) return false;
+    if ((colorBitmap & BLUE_MASK) && !VerifyGlowRampColor()) return false;
+    if ((colorBitmap & BRIGHT_MASK) && !VerifyGlowRampColor()) return false;
+
+    return VerifyLedMask(isSpanMask);
+}
+
+static bool VerifyPathInstructions()
+{
+    uint32_t instrBitAddress, instr, value;
+
+    while (GetCurrentInstrBitAddress() < instrBitLimit)
+    {
+        instrBitAddress = GetCurrentInstrBitAddress();
+
+        // Stop at zero padding bits of path's last byte:
+        if (instrBitLimit - instrBitAddress < BITS_PER_BYTE
+            && GetInstrBitfieldValue(instrBitAddress, instrBitLimit - instrBitAddress) == 0) break;
+
+        if (!GetNextVerifiedInstrBitfieldValue(4, &instr)) return false;
+
+        if (instr == Pc2Dev_PathActivate)
+        {
+            if (!GetNextVerifiedInstrBitfieldValue(8, &value)) return false;
+            if (value >= gContext.totalPaths_Value) return false;
+        }
+        else if (instr == Pc2Dev_GlowImmediate)
+        {
+            if (!VerifyGlowImmediate(false)) return false;
+        }
+        else if (instr == Pc2Dev_GlowRamp)
+        {
+            if (!VerifyGlowRamp(instrBitAddress, false)) return false;
+        }
+#if GLOW_PROTOCOL_VERSION >= SPAN_MASK_PROTOCOL_VERSION
+        else if (instr == Pc2Dev_GlowImmediateSpans)
+        {
+            if (!VerifyGlowImmediate(true)) return false;
+        }
+        else if (instr == Pc2Dev_GlowRampSpans)
+        {
+            if (!VerifyGlowRamp(instrBitAddress, true)) return false;
+        }
+#endif
+        else if (instr == Pc2Dev_Pause)
+        {
+            if (!GetNextVerifiedTickValue(&value)) return false;
+            if (!IsValueFitting(value, pauseTicksBitWidth)) return false;
+            if (!IsValueFitting(GetCurrentInstrBitAddress(), instrBitAddressBitWidth)) return false;
+        }
+        else if (instr == Pc2Dev_Here)
+        {
+            continue;
+        }
+        else if (instr == Pc2Dev_Goto)
+        {
+            if (!GetNextVerifiedInstrBitfieldValue(32, &value)) return false;
+            if (value >= instrBitLimit) return false;
+        }
+        else if (instr == Pc2Dev_PathEnd)
+        {
+            continue;
+        }
+        else
+        {
+            return false;   // unknown opcode.
+        }
+    }
+
+    return true;
+}
+
+bool StartVerifyAnimation(bool isSaveToRom)
+{
+    // Verify metadata-region common data:
+    if (gContext.totalLeds_Value != ledstripBuffer.numLeds) return false;
+    contextBitLimit = (uint32_t)gContext.contextRegionByteLen_Value * BITS_PER_BYTE;
+    if (gContext.firstContextBlock_BitAddress > contextBitLimit) return false;
+
+    if (isSaveToRom)
+    {
+#ifdef NVM_BUF_START_ADDR
+        if ((uint64_t)gContext.contextRegionByteLen_Value + gContext.instrRegionByteLen_Value > NVM_BUF_END_ADDR - gContext.nvmStartAddr) return false;
+#else
+        return false;
+#endif
+    }
+    else if ((uint64_t)gContext.contextRegionByteLen_Value + gContext.instrRegionByteLen_Value > SRAM_BUF_SZ) return false;
+
+    nextPathIdx = 0;
+    nextContextBlock_BitAddress = gContext.firstContextBlock_BitAddress;
+
+    return true;
+}
+
+bool VerifyNextAnimationPath(bool isSaveToRom)
+{
+    uint32_t pathStartByteAddress, pathByteLen, instrBitAddress, value;
+    uint8_t bitfieldWidth;
+
+    if (nextPathIdx >= gContext.totalPaths_Value) return true;
+
+    // Verify path's metadata-block:
+    SetCurrentContextBitAddress(nextContextBlock_BitAddress);
+    if (!GetNextVerifiedContextField(2, &bitfieldWidth, &pathStartByteAddress)) return false;
+    if (!GetNextVerifiedContextField(2, &bitfieldWidth, &pathByteLen)) return false;
+    if (!GetNextVerifiedContextField(2, &instrBitAddressBitWidth, &instrBitAddress)) return false;
+    if (!GetNextVerifiedContextField(3, &extraValueBitWidth, &value)) return false;
+    if (!GetNextVerifiedContextField(3, &pauseTicksBitWidth, &value)) return false;
+
+    if ((uint64_t)pathStartByteAddress + pathByteLen > gContext.instrRegionByteLen_Value) return false;
+
+    nextContextBlock_BitAddress = GetCurrentContextBitAddress();
+
+#ifdef NVM_BUF_START_ADDR
+    if (isSaveToRom)
+    {
+        // Load path's instructions into sram as the context switch in RunAnimation does:
+        if (!gContext.isInstrRegionPacked && pathByteLen > (uint32_t)SRAM_BUF_SZ - gContext.contextSramByteLen) return false;
+        pathByteLen = LoadPathInstructions(pathStartByteAddress, pathByteLen);
+        if (gContext.isInstrRegionPacked && pathByteLen == 0) return false;
+        InitInstrBitHandler(ptrSramBufferStart + gContext.contextSramByteLen);
+    }
+    else
+#endif
+    {
+        InitInstrBitHandler(ptrSramBufferStart + gContext.contextRegionByteLen_Value + pathStartByteAddress);
+    }
+
+    // Verify path's instructions:
+    if ((uint64_t)pathByteLen * BITS_PER_BYTE > UINT32_MAX) return false;
+    instrBitLimit = pathByteLen * BITS_PER_BYTE;
+    if (instrBitAddress >= instrBitLimit) return false;
+
+    if (!VerifyPathInstructions()) return false;
+
+    nextPathIdx++;
+
+    return true;
+}
+
+bool IsAnimationVerified()
+{
+    return nextPathIdx >= gContext.totalPaths_Value;
+}
+
+bool VerifyAnimation(bool isSaveToRom)
+{
+    if (!StartVerifyAnimation(isSaveToRom)) return false;
+
+    // Verify each path's metadata-block and instructions:
+    while (!IsAnimationVerified())
+    {
+        if (!VerifyNextAnimationPath(isSaveToRom)) return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,41 @@
+/*
+ *  Copyright 2018-2021 ledmaker.org
+ *
+ *  This file is part of Glow Decompiler Lib.
+ *
+ */
+
+#ifndef VERIFY_ANIMATION_H_
+#define VERIFY_ANIMATION_H_
+
+/**
+ * Walk the metadata-region and every instruction path once, checking that the animation can be decoded
+ * without any decode-time checks. Metadata-region common data must already be decoded into gContext.
+ *
+ * param[in]: isSaveToRom: Specifies whether animation binary data is in ROM region or SRAM region.
+ *
+ * return: Verification status.
+**/
+extern bool VerifyAnimation(bool isSaveToRom);
+
+/**
+ * Verify metadata-region common data and start verifying paths from the first one, for callers that spread
+ * verification over several calls of VerifyNextAnimationPath.
+ *
+ * return: Verification status.
+**/
+extern bool StartVerifyAnimation(bool isSaveToRom);
+
+/**
+ * Verify the next path's metadata-block and instructions.
+ *
+ * return: Verification status.
+**/
+extern bool VerifyNextAnimationPath(bool isSaveToRom);
+
+/**
+ * Check whether all paths of the animation in gContext have been verified.
+**/
+extern bool IsAnimationVerified();
+
+#endif /* VERIFY_ANIMATION_H_ */
@@ -0,0 +1,71 @@
+/*
+ *  Copyright 2018-2021 ledmaker.org
+ *
+ *  This file is part of Glow Decompiler Lib.
+ *
+ */
+
+#include "public_api.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#if defined(GLOW_APPLY_WORKERS) || defined(GLOW_PATH_WORKERS)
+
+#include <pthread.h>
+#include "worker_pool.h"
+
+bool WaitWorkerPoolRelease(struct WorkerPool *ptrPool)
+{
+    pthread_mutex_lock(&ptrPool->poolMutex);
+    while (!ptrPool->isPoolReleased) pthread_cond_wait(&ptrPool->poolCond, &ptrPool->poolMutex);
+    pthread_mutex_unlock(&ptrPool->poolMutex);
+
+    return !ptrPool->isPoolFailed;
+}
+
+bool StartWorkerPool(struct WorkerPool *ptrPool, void *(*ptrWorkerEntry)(void *))
+{
+    uintptr_t numWorkers = 0;
+
+    if (ptrPool->isPoolStarted || ptrPool->isPoolFailed) return ptrPool->isPoolStarted;
+
+    if (pthread_barrier_init(&ptrPool->startBarrier, NULL, ptrPool->numWorkers + 1) != 0)
+    {
+        ptrPool->isPoolFailed = true;
+        return false;
+    }
+    if (pthread_barrier_init(&ptrPool->doneBarrier, NULL, ptrPool->numWorkers + 1) != 0)
+    {
+        pthread_barrier_destroy(&ptrPool->startBarrier);
+        ptrPool->isPoolFailed = true;
+        return false;
+    }
+
+    while (numWorkers < ptrPool->numWorkers
+        && pthread_create(&ptrPool->ptrWorkers[numWorkers], NULL, ptrWorkerEntry, (void *)(numWorkers + 1)) == 0)
+    {
+        numWorkers++;
+    }
+
+    pthread_mutex_lock(&ptrPool->poolMutex);
+    ptrPool->isPoolFailed = (numWorkers < ptrPool->numWorkers);
+    ptrPool->isPoolReleased = true;
+    pthread_cond_broadcast(&ptrPool->poolCond);
+    pthread_mutex_unlock(&ptrPool->poolMutex);
+
+    // Tear down a partial pool, whose barriers could never be passed:
+    if (ptrPool->isPoolFailed)
+    {
+        for (uintptr_t workerIdx = 0; workerIdx < numWorkers; workerIdx++) pthread_join(ptrPool->ptrWorkers[workerIdx], NULL);
+        pthread_barrier_destroy(&ptrPool->startBarrier);
+        pthread_barrier_destroy(&ptrPool->doneBarrier);
+        return false;
+    }
+
+    ptrPool->isPoolStarted = true;
+
+    return true;
+}
+
+#endif
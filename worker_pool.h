@@ -0,0 +1,54 @@
+/*
+ *  Copyright 2018-2021 ledmaker.org
+ *
+ *  This file is part of Glow Decompiler Lib.
+ *
+ */
+
+#ifndef WORKER_POOL_H_
+#define WORKER_POOL_H_
+
+#if defined(GLOW_APPLY_WORKERS) || defined(GLOW_PATH_WORKERS)
+
+/**
+ * Worker threads that each run one share of a job between the start and done barriers, alongside the calling thread.
+ * Worker n is passed n + 1 as its argument, share zero is left to the calling thread.
+**/
+struct WorkerPool
+{
+    pthread_t *ptrWorkers;
+    uint8_t numWorkers;
+    pthread_barrier_t startBarrier;
+    pthread_barrier_t doneBarrier;
+    pthread_mutex_t poolMutex;
+    pthread_cond_t poolCond;
+    bool isPoolReleased;    // all worker creations attempted, guarded by poolMutex.
+    bool isPoolStarted;
+    bool isPoolFailed;      // pool could not start, the job is run serially.
+};
+
+#define WORKER_POOL_INITIALIZER(workers) \
+    { (workers), sizeof(workers) / sizeof((workers)[0]), .poolMutex = PTHREAD_MUTEX_INITIALIZER, \
+        .poolCond = PTHREAD_COND_INITIALIZER }
+
+/**
+ * Start the pool's worker threads on first call. If any worker cannot be created, the workers already created are
+ * joined and later calls return false.
+ *
+ * param[in]: ptrPool: pool to start.
+ * param[in]: ptrWorkerEntry: worker thread entry, which must call WaitWorkerPoolRelease before any barrier.
+ *
+ * return: Whether the workers run.
+**/
+extern bool StartWorkerPool(struct WorkerPool *ptrPool, void *(*ptrWorkerEntry)(void *));
+
+/**
+ * Wait in a worker thread until every worker of the pool is created.
+ *
+ * return: Whether the pool started, the worker must exit otherwise.
+**/
+extern bool WaitWorkerPoolRelease(struct WorkerPool *ptrPool);
+
+#endif
+
+#endif /* WORKER_POOL_H_ */